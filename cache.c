@@ -0,0 +1,410 @@
+// A source file that defines the command result cache used by the cache built-in command
+
+#define _GNU_SOURCE // Needed for copy_file_range
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <limits.h>
+#include <dirent.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+
+#include "cache.h"
+#include "hash.h"
+#include "vars.h"
+#include "memstats.h"
+
+#define CACHE_BLOCK_SIZE 4096 // Entry headers are padded to a multiple of this so the result can be cloned
+
+/** An entry of the cache store, used when deciding which entries to evict. */
+typedef struct {
+    char name[32];           /* File name of the entry inside the store. */
+    off_t size;              /* Size of the entry in bytes. */
+    struct timespec used;    /* Last time the entry was stored or restored. */
+} cache_entry_t;
+
+/** Appends bytes to the material of a key, growing it as needed. */
+static int append_material(cache_key_t *key, size_t *capacity, const void *data, size_t length) {
+    // If the material is full, double its size
+    if (key->length + length > *capacity) {
+        size_t grown_capacity = *capacity ? *capacity * 2 : 256;
+        while (grown_capacity < key->length + length) {
+            grown_capacity *= 2;
+        }
+        char *grown = (char *)memstats_realloc(MEMSTATS_CACHE, key->material, grown_capacity);
+        if (grown == NULL) {
+            return 1;
+        }
+        key->material = grown;
+        *capacity = grown_capacity;
+    }
+
+    memcpy(key->material + key->length, data, length);
+    key->length += length;
+    return 0;
+}
+
+/** Appends the identity of a file (device, inode, size and modification time) to the material of a key. */
+static int append_file(cache_key_t *key, size_t *capacity, const char *path) {
+    struct stat info; // Declare a structure to hold the file's metadata
+
+    // If the file could not be examined, the key cannot be computed
+    if (stat(path, &info) == -1) {
+        return 1;
+    }
+
+    return append_material(key, capacity, &info.st_dev, sizeof(info.st_dev))
+        || append_material(key, capacity, &info.st_ino, sizeof(info.st_ino))
+        || append_material(key, capacity, &info.st_size, sizeof(info.st_size))
+        || append_material(key, capacity, &info.st_mtim, sizeof(info.st_mtim));
+}
+
+/** Finds the size of the header of an entry, which holds the length of the key material and the material. */
+static off_t header_size(size_t length) {
+    return (sizeof(unsigned long long) + length + CACHE_BLOCK_SIZE - 1) / CACHE_BLOCK_SIZE * CACHE_BLOCK_SIZE;
+}
+
+// Finds the directory of the cache store, creating it if it does not exist yet
+const char *cache_dir() {
+    static char path[PATH_MAX]; // Declare a buffer to hold the path of the store
+    const char *configured = vars_lookup("MINISHELL_CACHE_DIR");
+
+    // If the location of the store was configured, use it as is
+    if (configured != NULL && configured[0] != '\0') {
+        snprintf(path, sizeof(path), "%s", configured);
+    }
+
+    // Otherwise, place the store in the user's cache directory
+    else {
+        const char *home = vars_lookup("HOME");
+        snprintf(path, sizeof(path), "%s/.cache", home ? home : ".");
+        mkdir(path, 0755);
+        snprintf(path, sizeof(path), "%s/.cache/mini-shell", home ? home : ".");
+    }
+
+    // Create the store, ignoring the error if it already exists
+    if (mkdir(path, 0755) == -1 && errno != EEXIST) {
+        return NULL;
+    }
+
+    return path;
+}
+
+/** Builds the path of the store entry for the given key. */
+static int entry_path(char *path, size_t size, unsigned long long key) {
+    const char *dir = cache_dir();
+
+    // If the store could not be created, there is no path
+    if (dir == NULL) {
+        return 1;
+    }
+
+    snprintf(path, size, "%s/%016llx", dir, key);
+    return 0;
+}
+
+/**
+ * Copies the rest of one file, from its current offset, into another at its current offset. A reflink is
+ * tried first so that filesystems with copy-on-write support share the data instead of copying it, then
+ * copy_file_range, which keeps the copy inside the kernel, and finally a plain read and write loop.
+ */
+static int copy_file(int in_fd, int out_fd) {
+    struct file_clone_range range = { .src_fd = in_fd, .src_offset = lseek(in_fd, 0, SEEK_CUR), .src_length = 0,
+                                      .dest_offset = lseek(out_fd, 0, SEEK_CUR) }; // Clone up to the end
+
+    // If the filesystem can share the data between both files, there is nothing left to copy
+    if (ioctl(out_fd, FICLONERANGE, &range) == 0) {
+        return 0;
+    }
+
+    ssize_t copied; // Declare a variable to hold the number of bytes copied in each step
+
+    // Let the kernel copy the data until the end of the input is reached
+    do {
+        copied = copy_file_range(in_fd, NULL, out_fd, NULL, 1 << 30, 0);
+    } while (copied > 0);
+
+    // If the kernel copied everything, the copy is complete
+    if (copied == 0) {
+        return 0;
+    }
+
+    // If copy_file_range is not supported between these files, fall back to reading and writing
+    if (errno != EXDEV && errno != ENOSYS && errno != EINVAL && errno != EOPNOTSUPP) {
+        return 1;
+    }
+
+    char buffer[65536]; // Declare a buffer to hold each chunk of the file
+    ssize_t length; // Declare a variable to hold the length of each chunk
+
+    // Copy chunks until the end of the input is reached
+    while ((length = read(in_fd, buffer, sizeof(buffer))) > 0) {
+        if (write(out_fd, buffer, length) != length) {
+            return 1;
+        }
+    }
+
+    return length == -1;
+}
+
+/** Orders cache entries from the least to the most recently used. */
+static int compare_entries(const void *a, const void *b) {
+    const cache_entry_t *first = (const cache_entry_t *)a;
+    const cache_entry_t *second = (const cache_entry_t *)b;
+
+    if (first->used.tv_sec != second->used.tv_sec) {
+        return first->used.tv_sec < second->used.tv_sec ? -1 : 1;
+    }
+    if (first->used.tv_nsec != second->used.tv_nsec) {
+        return first->used.tv_nsec < second->used.tv_nsec ? -1 : 1;
+    }
+    return 0;
+}
+
+/**
+ * Removes the least recently used entries from the store until its total size is within the limit given
+ * by $MINISHELL_CACHE_LIMIT (in bytes), or CACHE_DEFAULT_LIMIT if it is not set.
+ */
+static void cache_evict(const char *dir) {
+    const char *configured = vars_lookup("MINISHELL_CACHE_LIMIT");
+    unsigned long long limit = configured ? strtoull(configured, NULL, 10) : CACHE_DEFAULT_LIMIT;
+
+    DIR *store = opendir(dir); // Open the store to list its entries
+
+    // If the store could not be opened, there is nothing to evict
+    if (store == NULL) {
+        return;
+    }
+
+    cache_entry_t *entries = NULL; // Declare an array to hold the entries of the store
+    size_t count = 0, capacity = 0; // Track how many entries there are and how many fit in the array
+    unsigned long long total = 0; // Track the total size of the store
+    struct dirent *item; // Declare a pointer to hold each item of the directory
+
+    // Collect the size and last use of every entry
+    while ((item = readdir(store)) != NULL) {
+        struct stat info; // Declare a structure to hold the entry's metadata
+
+        // Skip anything that is not a finished entry (hidden files include partially written ones)
+        if (item->d_name[0] == '.' || strlen(item->d_name) >= sizeof(entries[0].name)
+            || fstatat(dirfd(store), item->d_name, &info, 0) == -1 || !S_ISREG(info.st_mode)) {
+            continue;
+        }
+
+        // If the array is full, double its size
+        if (count == capacity) {
+            capacity = capacity ? capacity * 2 : 64;
+            cache_entry_t *grown = (cache_entry_t *)memstats_realloc(MEMSTATS_CACHE, entries, capacity * sizeof(cache_entry_t));
+            if (grown == NULL) {
+                break;
+            }
+            entries = grown;
+        }
+
+        strcpy(entries[count].name, item->d_name);
+        entries[count].size = info.st_size;
+        entries[count].used = info.st_mtim;
+        total += info.st_size;
+        count++;
+    }
+
+    // If the store is over its limit, remove the least recently used entries first
+    if (total > limit) {
+        qsort(entries, count, sizeof(cache_entry_t), compare_entries);
+
+        for (size_t i = 0; i < count && total > limit; i++) {
+            if (unlinkat(dirfd(store), entries[i].name, 0) == 0) {
+                total -= entries[i].size;
+            }
+        }
+    }
+
+    memstats_free(entries);
+    closedir(store);
+}
+
+// Computes the key that identifies a cached command result
+int cache_key(const char **args, const char **assignments, unsigned int assignment_count, const char *input_file,
+              const char **dependencies, cache_key_t *key) {
+    size_t capacity = 0; // Track how many bytes the material can hold
+    char cwd[PATH_MAX]; // Declare a buffer to hold the working directory
+    int failed = 0; // Tracks whether the material could not be built
+
+    key->material = NULL;
+    key->length = 0;
+
+    // Relative paths in the arguments depend on the working directory, so it is part of the key
+    if (getcwd(cwd, sizeof(cwd)) != NULL) {
+        failed |= append_material(key, &capacity, cwd, strlen(cwd) + 1);
+    }
+
+    // Add each argument, including its null terminator so that "ab c" and "a bc" differ
+    for (unsigned int i = 0; !failed && args[i] != NULL; i++) {
+        failed |= append_material(key, &capacity, args[i], strlen(args[i]) + 1);
+    }
+
+    // Add the assignments in front of the command, which change its environment
+    for (unsigned int i = 0; !failed && i < assignment_count; i++) {
+        failed |= append_material(key, &capacity, "=", 1)
+                  || append_material(key, &capacity, assignments[i], strlen(assignments[i]) + 1);
+    }
+
+    // Add the identity of the input file
+    if (!failed && input_file != NULL) {
+        failed |= append_material(key, &capacity, "<", 1) || append_file(key, &capacity, input_file);
+    }
+
+    // Add the identity of each declared dependency
+    for (unsigned int i = 0; !failed && dependencies != NULL && dependencies[i] != NULL; i++) {
+        failed |= append_file(key, &capacity, dependencies[i]);
+    }
+
+    // If the key could not be computed, do not leave half of it behind
+    if (failed) {
+        cache_key_free(key);
+        return 1;
+    }
+
+    key->hash = hash_bytes(HASH_INIT, key->material, key->length);
+    return 0;
+}
+
+// Frees the material of a key computed by cache_key
+void cache_key_free(cache_key_t *key) {
+    memstats_free(key->material);
+    key->material = NULL;
+    key->length = 0;
+}
+
+/** Checks that the header of an entry holds the given key material, leaving the entry at its result. */
+static int matches_key(int entry_fd, const cache_key_t *key) {
+    unsigned long long length; // Declare a variable to hold the length of the stored material
+
+    // If the stored material has another length, the entry belongs to another command
+    if (read(entry_fd, &length, sizeof(length)) != sizeof(length) || length != key->length) {
+        return 0;
+    }
+
+    char *material = (char *)memstats_malloc(MEMSTATS_CACHE, key->length ? key->length : 1);
+
+    // If memory could not be allocated, the entry cannot be checked
+    if (material == NULL) {
+        return 0;
+    }
+
+    int matches = read(entry_fd, material, key->length) == (ssize_t)key->length
+                  && memcmp(material, key->material, key->length) == 0;
+
+    memstats_free(material);
+    return matches && lseek(entry_fd, header_size(key->length), SEEK_SET) != -1;
+}
+
+// Restores a previously stored result into the output file
+int cache_restore(const cache_key_t *key, const char *output_file) {
+    char path[PATH_MAX]; // Declare a buffer to hold the path of the entry
+
+    // If the store is unavailable, this is a miss
+    if (entry_path(path, sizeof(path), key->hash) != 0) {
+        return 1;
+    }
+
+    int entry_fd = open(path, O_RDONLY); // Attempt to open the stored result
+
+    // If there is no stored result, this is a miss
+    if (entry_fd == -1) {
+        return 1;
+    }
+
+    // If the entry was stored for another command whose key has the same hash, this is a miss too
+    if (!matches_key(entry_fd, key)) {
+        close(entry_fd);
+        return 1;
+    }
+
+    int output_fd = open(output_file, O_WRONLY | O_CREAT | O_TRUNC, 0644); // Open the output file
+
+    // If the output file could not be opened,
+    if (output_fd == -1) {
+        close(entry_fd);
+        return 1;
+    }
+
+    int result = copy_file(entry_fd, output_fd); // Copy the stored result into the output file
+
+    // Mark the entry as recently used so that eviction keeps it
+    if (result == 0) {
+        futimens(entry_fd, NULL);
+    }
+
+    close(output_fd);
+    close(entry_fd);
+    return result;
+}
+
+// Stores the contents of the output file in the cache under the given key
+int cache_store(const cache_key_t *key, const char *output_file) {
+    char path[PATH_MAX]; // Declare a buffer to hold the path of the entry
+    char temporary[PATH_MAX + 32]; // Declare a buffer to hold the path the entry is written to first
+
+    // If the store is unavailable, the result cannot be stored
+    if (entry_path(path, sizeof(path), key->hash) != 0) {
+        return 1;
+    }
+
+    // Build the header of the entry: the length of the key material, the material, then padding
+    off_t size = header_size(key->length);
+    char *header = (char *)memstats_calloc(MEMSTATS_CACHE, 1, size);
+
+    // If memory could not be allocated, the result cannot be stored
+    if (header == NULL) {
+        return 1;
+    }
+
+    unsigned long long length = key->length; // The length is stored with a fixed size
+    memcpy(header, &length, sizeof(length));
+    memcpy(header + sizeof(length), key->material, key->length);
+
+    // Write the entry under a hidden name first so that a half-written entry is never restored
+    char *slash = strrchr(path, '/');
+    snprintf(temporary, sizeof(temporary), "%.*s/.%s.%d", (int)(slash - path), path, slash + 1, (int)getpid());
+
+    int output_fd = open(output_file, O_RDONLY); // Open the result of the command
+
+    // If the result could not be opened,
+    if (output_fd == -1) {
+        memstats_free(header);
+        return 1;
+    }
+
+    int entry_fd = open(temporary, O_WRONLY | O_CREAT | O_TRUNC, 0644); // Create the new entry
+
+    // If the entry could not be created,
+    if (entry_fd == -1) {
+        memstats_free(header);
+        close(output_fd);
+        return 1;
+    }
+
+    // Write the header, then copy the result into the entry after it
+    int result = write(entry_fd, header, size) != size || copy_file(output_fd, entry_fd) != 0;
+    memstats_free(header);
+
+    close(entry_fd);
+    close(output_fd);
+
+    // Publish the finished entry under its real name, or throw it away if the copy failed
+    if (result != 0 || rename(temporary, path) != 0) {
+        unlink(temporary);
+        return 1;
+    }
+
+    *slash = '\0'; // Cut the path down to the directory of the store
+    cache_evict(path); // Keep the store within its size limit
+    return 0;
+}
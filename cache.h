@@ -0,0 +1,76 @@
+// A header file that declares the command result cache used by the cache built-in command
+
+#ifndef _CACHE_H
+#define _CACHE_H
+
+#define CACHE_DEFAULT_LIMIT (256ULL * 1024 * 1024) // Default size limit of the cache store (256 MiB)
+#define CACHE_MAX_DEPENDENCIES 32 // Maximum number of dependencies that can be declared for one command
+
+#include <stddef.h>
+
+/** The key of a cached command result. */
+typedef struct {
+    unsigned long long hash;    /* FNV-1a hash of the material, which names the entry in the store. */
+    char *material;             /* Everything the key covers, stored with the entry and compared on restore. */
+    size_t length;              /* The number of bytes of the material. */
+} cache_key_t;
+
+/**
+ * Finds the directory of the cache store, creating it if it does not exist yet. The store lives in
+ * $MINISHELL_CACHE_DIR if it is set, and in ~/.cache/mini-shell otherwise.
+ *
+ * @return The path of the store, or NULL if it could not be created.
+ */
+const char *cache_dir();
+
+/**
+ * Computes the key that identifies a cached command result.
+ *
+ * The key covers the working directory, every argument of the command, the NAME=value assignments that
+ * go into its environment, and the device, inode, size and modification time of the input file and of each declared dependency. Any change to one of these produces
+ * a different key. The hash only names the entry: the material itself is stored with the entry and compared
+ * on restore, so two commands whose hashes collide never get each other's result.
+ *
+ * @param args A NULL-terminated array holding the command and its arguments.
+ * @param assignments The NAME=value assignments in front of the command (can be NULL when count is 0).
+ * @param assignment_count The number of assignments.
+ * @param input_file The file redirected to the command's standard input (can be NULL).
+ * @param dependencies A NULL-terminated array of additional files the result depends on (can be NULL).
+ * @param key A pointer to where the key will be stored. Free it with cache_key_free once it is not needed.
+ *
+ * @return 0 for success, 1 if one of the files could not be examined or memory could not be allocated.
+ */
+int cache_key(const char **args, const char **assignments, unsigned int assignment_count, const char *input_file,
+              const char **dependencies, cache_key_t *key);
+
+/**
+ * Frees the material of a key computed by cache_key.
+ *
+ * @param key The key to free.
+ */
+void cache_key_free(cache_key_t *key);
+
+/**
+ * Restores a previously stored result into the output file, cloning or copying it from the store. An entry
+ * whose stored key material differs from the key belongs to another command and counts as a miss.
+ *
+ * @param key The key of the result to restore.
+ * @param output_file The file the result should be written to.
+ *
+ * @return 0 for a cache hit, 1 if there is no stored result (or it could not be restored).
+ */
+int cache_restore(const cache_key_t *key, const char *output_file);
+
+/**
+ * Stores the contents of the output file in the cache under the given key, then evicts the least recently
+ * used entries until the store is back under its size limit. The entry starts with a header holding the key
+ * material, padded to a whole block so the result can still be cloned into and out of the entry.
+ *
+ * @param key The key to store the result under.
+ * @param output_file The file holding the result of the command.
+ *
+ * @return 0 for success, 1 for an error.
+ */
+int cache_store(const cache_key_t *key, const char *output_file);
+
+#endif
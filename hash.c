@@ -0,0 +1,18 @@
+// A source file that defines the FNV-1a hash shared by the variable table, the result cache and compiled plans
+
+#include "hash.h"
+
+#define FNV_PRIME 1099511628211ULL // Multiplier of the FNV-1a hash
+
+// Mixes the given bytes into a running FNV-1a hash
+unsigned long long hash_bytes(unsigned long long hash, const void *data, size_t length) {
+    const unsigned char *bytes = (const unsigned char *)data;
+
+    // Fold each byte into the hash
+    for (size_t i = 0; i < length; i++) {
+        hash ^= bytes[i];
+        hash *= FNV_PRIME;
+    }
+
+    return hash;
+}
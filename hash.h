@@ -0,0 +1,21 @@
+// A header file that declares the FNV-1a hash shared by the variable table, the result cache and compiled plans
+
+#ifndef _HASH_H
+#define _HASH_H
+
+#include <stddef.h>
+
+#define HASH_INIT 14695981039346656037ULL // Starting value of a hash (the FNV-1a offset basis)
+
+/**
+ * Mixes the given bytes into a running FNV-1a hash. Start from HASH_INIT.
+ *
+ * @param hash The hash computed so far.
+ * @param data A pointer to the bytes to mix in.
+ * @param length The number of bytes to mix in.
+ *
+ * @return The updated hash.
+ */
+unsigned long long hash_bytes(unsigned long long hash, const void *data, size_t length);
+
+#endif
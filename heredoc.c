@@ -0,0 +1,120 @@
+// A source file that defines the functions used to feed here-documents and here-strings to commands
+
+#define _GNU_SOURCE // Needed for memfd_create and pipe2
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <errno.h>
+#include <sys/mman.h>
+
+#include "tokens.h"
+#include "heredoc.h"
+#include "memstats.h"
+
+// Reads the body of a here-document up to the line holding the delimiter
+char *read_here_document(FILE *in, const char *delimiter, size_t *length) {
+    size_t capacity = MAX_INPUT_LENGTH; // Start with room for one full line
+    char *body = (char *)memstats_malloc(MEMSTATS_HEREDOC, capacity); // Allocate the buffer that will hold the body
+    char *line = NULL; // Declare a buffer to read each line of the body, grown by getline to fit any line
+    size_t line_capacity = 0; // Declare a variable to hold the size of that buffer
+    ssize_t line_length; // Declare a variable to hold the length of the current line
+
+    *length = 0; // The body starts out empty
+
+    // If memory could not be allocated, return NULL
+    if (body == NULL) {
+        return NULL;
+    }
+
+    // Read lines until the delimiter line or the end of the input is reached
+    while ((line_length = getline(&line, &line_capacity, in)) != -1) {
+
+        // If this line is the delimiter, the here-document is complete
+        if (strncmp(line, delimiter, strlen(delimiter)) == 0 && strcspn(line, "\n") == strlen(delimiter)) {
+            break;
+        }
+
+        // If the buffer is too small to hold this line, double its size until it fits
+        if (*length + line_length > capacity) {
+            while (*length + line_length > capacity) {
+                capacity *= 2;
+            }
+            char *grown = (char *)memstats_realloc(MEMSTATS_HEREDOC, body, capacity);
+
+            // If memory could not be allocated, give up on the body
+            if (grown == NULL) {
+                memstats_free(body);
+                free(line);
+                return NULL;
+            }
+            body = grown;
+        }
+
+        memcpy(body + *length, line, line_length); // Append the line to the body
+        *length += line_length; // Update the length of the body
+    }
+
+    free(line); // Free the line buffer, which getline allocated
+    return body;
+}
+
+// Creates a file descriptor from which the given data can be read
+int make_input_fd(const char *data, size_t length) {
+
+    // If the data fits in an empty pipe, writing it can never block
+    if (length <= PIPE_BUF) {
+        int pipefd[2]; // Declare an array to hold the read and write end of the pipe
+
+        // Attempts to create a pipe. If the pipe cannot be created, return an error
+        if (pipe2(pipefd, O_CLOEXEC) == -1) {
+            return -1;
+        }
+
+        ssize_t result = write(pipefd[1], data, length); // Write the data into the pipe
+
+        // If the write failed, close the pipe while keeping the reason in errno
+        if (result != (ssize_t)length) {
+            int error = result == -1 ? errno : EIO;
+            close(pipefd[0]);
+            close(pipefd[1]);
+            errno = error;
+            return -1;
+        }
+
+        // Close the write end so the reader sees end-of-file
+        close(pipefd[1]);
+
+        return pipefd[0]; // Return the read end of the pipe
+    }
+
+    // Otherwise, create an anonymous in-memory file to hold the data
+    int fd = memfd_create("here-document", MFD_CLOEXEC);
+
+    // If the in-memory file could not be created, return an error
+    if (fd == -1) {
+        return -1;
+    }
+
+    size_t written = 0; // Tracks how many bytes have been written so far
+
+    // Keep writing until all of the data is in the file
+    while (written < length) {
+        ssize_t result = write(fd, data + written, length - written);
+
+        // If the write failed,
+        if (result == -1) {
+            int error = errno; // Keep the reason, which close could overwrite
+            close(fd);
+            errno = error;
+            return -1;
+        }
+        written += result;
+    }
+
+    lseek(fd, 0, SEEK_SET); // Rewind the file so the command reads it from the beginning
+    return fd;
+}
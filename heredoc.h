@@ -0,0 +1,32 @@
+// A header file that declares the functions used to feed here-documents and here-strings to commands
+
+#ifndef _HEREDOC_H
+#define _HEREDOC_H
+
+#include <stdio.h>
+
+/**
+ * Reads the body of a here-document, line by line, until a line consisting only of the delimiter is found.
+ *
+ * @param in The stream to read the body from (the terminal or a sourced file).
+ * @param delimiter A null-terminated string that marks the end of the here-document.
+ * @param length A pointer that will be set to the number of bytes in the body.
+ *
+ * @return A heap-allocated buffer holding the body, which the caller is responsible for freeing.
+ */
+char *read_here_document(FILE *in, const char *delimiter, size_t *length);
+
+/**
+ * Creates a file descriptor from which the given data can be read, to be used as the standard input of a
+ * command. Small payloads that fit in a pipe are written into one directly. Anything larger goes into an
+ * anonymous in-memory file, so the shell never blocks writing data that nobody is reading yet.
+ *
+ * @param data A pointer to the bytes that should be readable from the descriptor.
+ * @param length The number of bytes of data.
+ *
+ * @return A file descriptor positioned at the start of the data, or -1 with errno set if it could not be
+ *         created. Nothing is printed, as this is part of the library.
+ */
+int make_input_fd(const char *data, size_t length);
+
+#endif
@@ -0,0 +1,160 @@
+// A source file that defines the allocation counters behind the memstats built-in command
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <malloc.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+#include "memstats.h"
+
+/** Counters kept for each subsystem. */
+typedef struct {
+    unsigned long long allocations; /* Number of blocks allocated (or resized). */
+    unsigned long long bytes;       /* Number of bytes requested. */
+} memstats_counter_t;
+
+#ifndef MEMSTATS_DISABLED
+
+// Names of the subsystems, in the order of their numbers
+static const char *subsystem_names[MEMSTATS_SUBSYSTEMS] = {
+    "shell", "tokens", "vect", "plan", "engine", "cache", "heredoc", "vars"
+};
+
+static memstats_counter_t counters[MEMSTATS_SUBSYSTEMS]; // The counters of each subsystem
+static memstats_counter_t reported[MEMSTATS_SUBSYSTEMS]; // The counters as of the last report
+static unsigned long long frees; // Number of blocks freed
+static unsigned long long live_bytes; // Number of bytes currently allocated (as usable sizes)
+static unsigned long long peak_live_bytes; // Highest number of bytes allocated at once
+static unsigned long long vect_growths; // Number of times a vector grew its data array
+static unsigned long long reported_vect_growths; // Number of vector growths as of the last report
+static int attributed = -1; // The subsystem shared code charges its allocations to (-1 for its own)
+
+/** Counts a new block against a subsystem. */
+static void count(int subsystem, void *ptr, size_t size) {
+    if (ptr == NULL) {
+        return;
+    }
+
+    counters[subsystem].allocations++;
+    counters[subsystem].bytes += size;
+    live_bytes += malloc_usable_size(ptr);
+
+    if (live_bytes > peak_live_bytes) {
+        peak_live_bytes = live_bytes;
+    }
+}
+
+// Allocates memory, counting it against the given subsystem
+void *memstats_malloc(int subsystem, size_t size) {
+    void *ptr = malloc(size);
+    count(subsystem, ptr, size);
+    return ptr;
+}
+
+// Allocates zeroed memory, counting it against the given subsystem
+void *memstats_calloc(int subsystem, size_t number, size_t size) {
+    void *ptr = calloc(number, size);
+    count(subsystem, ptr, number * size);
+    return ptr;
+}
+
+// Resizes memory, counting the new block against the given subsystem
+void *memstats_realloc(int subsystem, void *ptr, size_t size) {
+    size_t old_size = ptr ? malloc_usable_size(ptr) : 0; // The usable size of the old block
+    void *grown = realloc(ptr, size);
+
+    // The old block is only released if the resize succeeded
+    if (grown != NULL) {
+        live_bytes -= old_size;
+        count(subsystem, grown, size);
+    }
+
+    return grown;
+}
+
+// Copies a string into new memory, counting it against the given subsystem
+char *memstats_strdup(int subsystem, const char *string) {
+    char *copy = strdup(string);
+    count(subsystem, copy, strlen(string) + 1);
+    return copy;
+}
+
+// Frees memory allocated by any of the wrappers
+void memstats_free(void *ptr) {
+    if (ptr == NULL) {
+        return;
+    }
+
+    frees++;
+    live_bytes -= malloc_usable_size(ptr);
+    free(ptr);
+}
+
+// Charges the allocations of shared code to a subsystem, returning the subsystem charged before
+int memstats_attribute(int subsystem) {
+    int previous = attributed;
+    attributed = subsystem;
+    return previous;
+}
+
+// Returns the subsystem that shared code should charge
+int memstats_owner(int fallback) {
+    return attributed != -1 ? attributed : fallback;
+}
+
+// Counts a vector growing its data array
+void memstats_vect_growth() {
+    vect_growths++;
+}
+
+#endif
+
+/** Reads the current resident size of the process in KiB from /proc, or returns 0 if it is unavailable. */
+static long current_resident_kib() {
+    long pages = 0; // Declare a variable to hold the number of resident pages
+    FILE *statm = fopen("/proc/self/statm", "r");
+
+    // The second field of statm is the number of resident pages
+    if (statm != NULL) {
+        if (fscanf(statm, "%*s %ld", &pages) != 1) {
+            pages = 0;
+        }
+        fclose(statm);
+    }
+
+    return pages * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+// Prints the allocation counters, along with the change since the last report
+void memstats_print(FILE *out) {
+    struct rusage usage; // Declare a structure to hold the resource usage of the process
+
+#ifdef MEMSTATS_DISABLED
+    fprintf(out, "Allocation counting was disabled when the shell was built (MEMSTATS_DISABLED).\n");
+#else
+    unsigned long long total_allocations = 0, total_bytes = 0; // Totals over every subsystem
+
+    fprintf(out, "%-10s %14s %16s %14s %16s\n", "subsystem", "allocations", "bytes", "+allocations", "+bytes");
+
+    // Print the counters of each subsystem and how much they grew since the last report
+    for (int i = 0; i < MEMSTATS_SUBSYSTEMS; i++) {
+        fprintf(out, "%-10s %14llu %16llu %14llu %16llu\n", subsystem_names[i], counters[i].allocations,
+                counters[i].bytes, counters[i].allocations - reported[i].allocations,
+                counters[i].bytes - reported[i].bytes);
+        total_allocations += counters[i].allocations;
+        total_bytes += counters[i].bytes;
+        reported[i] = counters[i];
+    }
+
+    fprintf(out, "%-10s %14llu %16llu\n", "total", total_allocations, total_bytes);
+    fprintf(out, "frees: %llu, live bytes: %llu (peak %llu)\n", frees, live_bytes, peak_live_bytes);
+    fprintf(out, "vect growth events: %llu (+%llu)\n", vect_growths, vect_growths - reported_vect_growths);
+    reported_vect_growths = vect_growths;
+#endif
+
+    // Print the resident size of the whole process, which includes memory not allocated through the wrappers
+    getrusage(RUSAGE_SELF, &usage);
+    fprintf(out, "resident size: %ld KiB (peak %ld KiB)\n", current_resident_kib(), usage.ru_maxrss);
+}
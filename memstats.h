@@ -0,0 +1,78 @@
+// A header file that declares the allocation counters behind the memstats built-in command
+//
+// Every allocation made by the shell goes through the wrappers below, which count it against a subsystem.
+// Building with -DMEMSTATS_DISABLED turns the wrappers back into the plain allocation functions.
+
+#ifndef _MEMSTATS_H
+#define _MEMSTATS_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Subsystems that allocations are counted against
+#define MEMSTATS_SHELL 0 // The interactive front end (shell.c)
+#define MEMSTATS_TOKENS 1 // Everything allocated while tokenizing a line, including its vectors
+#define MEMSTATS_VECT 2 // Vectors used outside of the tokenizer
+#define MEMSTATS_PLAN 3 // Compiling and loading plans
+#define MEMSTATS_ENGINE 4 // Running commands and plans
+#define MEMSTATS_CACHE 5 // The command result cache
+#define MEMSTATS_HEREDOC 6 // Here-documents and here-strings
+#define MEMSTATS_VARS 7 // The shell variables and the environment given to commands
+#define MEMSTATS_SUBSYSTEMS 8 // Number of subsystems
+
+#ifndef MEMSTATS_DISABLED
+
+/** Allocate memory, counting it against the given subsystem. */
+void *memstats_malloc(int subsystem, size_t size);
+
+/** Allocate zeroed memory, counting it against the given subsystem. */
+void *memstats_calloc(int subsystem, size_t count, size_t size);
+
+/** Resize memory, counting the new block against the given subsystem. */
+void *memstats_realloc(int subsystem, void *ptr, size_t size);
+
+/** Copy a string into new memory, counting it against the given subsystem. */
+char *memstats_strdup(int subsystem, const char *string);
+
+/** Free memory allocated by any of the wrappers. */
+void memstats_free(void *ptr);
+
+/**
+ * Charge the allocations of shared code (such as vectors) to a subsystem until the previous owner is restored.
+ *
+ * @param subsystem The subsystem to charge, or -1 to let shared code charge its own subsystem.
+ *
+ * @return The subsystem that was charged before, to be passed back when the caller is done.
+ */
+int memstats_attribute(int subsystem);
+
+/** The subsystem that shared code should charge, which is fallback unless another subsystem was attributed. */
+int memstats_owner(int fallback);
+
+/** Count a vector growing its data array. */
+void memstats_vect_growth();
+
+#else
+
+#define memstats_malloc(subsystem, size) malloc(size)
+#define memstats_calloc(subsystem, count, size) calloc(count, size)
+#define memstats_realloc(subsystem, ptr, size) realloc(ptr, size)
+#define memstats_strdup(subsystem, string) strdup(string)
+#define memstats_free(ptr) free(ptr)
+static inline int memstats_attribute(int subsystem) { (void)subsystem; return -1; }
+static inline int memstats_owner(int fallback) { return fallback; }
+static inline void memstats_vect_growth() { }
+
+#endif
+
+/**
+ * Prints the allocation counts and byte totals of each subsystem (along with the change since the last
+ * report), the number of frees, the bytes currently allocated, the number of vector growth events, and the
+ * current and peak resident size of the process.
+ *
+ * @param out The stream to print the report to.
+ */
+void memstats_print(FILE *out);
+
+#endif
@@ -0,0 +1,1280 @@
+// A source file that defines the embeddable mini-shell library
+
+#define _GNU_SOURCE // Needed for pipe2, memfd_create and strchrnul
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include "tokens.h"
+#include "heredoc.h"
+#include "pipes.h"
+#include "plan.h"
+#include "minishell.h"
+#include "vars.h"
+#include "memstats.h"
+
+static minishell_hooks_t hooks; // The hooks installed by the caller
+
+/** Records why a command could not be run and returns -1. */
+static int fail(minishell_status_t *status, const char *stage, int error) {
+    status->exit_status = -1;
+    status->signal = 0;
+    status->error = error;
+    status->stage = stage;
+    return -1;
+}
+
+/** Records the outcome of a command that has finished, as reported by waitpid. */
+static void record(minishell_status_t *status, int wait_status) {
+    status->exit_status = WIFEXITED(wait_status) ? WEXITSTATUS(wait_status) : -1;
+    status->signal = WIFSIGNALED(wait_status) ? WTERMSIG(wait_status) : 0;
+    status->error = 0;
+    status->stage = NULL;
+}
+
+/**
+ * Replaces the current process with the program at the given path. Like execvp, a file that the kernel cannot
+ * run (such as a script without a #! line) is run by /bin/sh instead. Only returns if it could not be run.
+ */
+static void exec_file(const char *path, const char **args, char *const *envp) {
+    execve(path, (char *const *)args, envp);
+
+    // If the file is not a format the kernel knows, hand it to the shell along with its arguments
+    if (errno == ENOEXEC) {
+        unsigned int argc = 0;
+        while (args[argc] != NULL) {
+            argc++;
+        }
+
+        const char *shell_args[argc + 2]; // Declare an array to hold "sh", the path and the other arguments
+        shell_args[0] = "sh";
+        shell_args[1] = path;
+        memcpy(shell_args + 2, args + 1, argc * sizeof(char *)); // Also copies the terminating NULL
+
+        execve("/bin/sh", (char *const *)shell_args, envp);
+        errno = ENOEXEC; // Report the original problem if there is no shell either
+    }
+}
+
+/**
+ * Replaces the current process with the given command, searching the directories of PATH (as found in the
+ * given environment) for a command name that has no '/' in it. Only returns if the command could not be run.
+ */
+static void exec_command(const char **args, char *const *envp) {
+    const char *path = "/bin:/usr/bin"; // The directories to search when PATH is not set
+    char candidate[PATH_MAX]; // Declare a buffer to hold the path of the command in each directory
+    size_t name_length = strlen(args[0]);
+    int error = ENOENT; // The error to report if the command is not found anywhere
+
+    // If the command is given as a path, there is nothing to search
+    if (strchr(args[0], '/') != NULL) {
+        exec_file(args[0], args, envp);
+        return;
+    }
+
+    // Find the value of PATH in the environment
+    for (unsigned int i = 0; envp[i] != NULL; i++) {
+        if (strncmp(envp[i], "PATH=", 5) == 0) {
+            path = envp[i] + 5;
+        }
+    }
+
+    // Try the command in each directory of PATH, in order
+    while (1) {
+        const char *end = strchrnul(path, ':'); // Find the end of the directory
+        size_t length = end - path;
+
+        // An empty directory stands for the current directory
+        if (length == 0) {
+            path = ".";
+            length = 1;
+        }
+
+        // If the path fits in the buffer, try to run it
+        if (length + 1 + name_length < sizeof(candidate)) {
+            memcpy(candidate, path, length);
+            candidate[length] = '/';
+            memcpy(candidate + length + 1, args[0], name_length + 1);
+            exec_file(candidate, args, envp);
+
+            // A command that exists but cannot be run is reported unless it is found elsewhere
+            if (errno == EACCES) {
+                error = EACCES;
+            } else if (errno != ENOENT && errno != ENOTDIR) {
+                return;
+            }
+        }
+
+        // If this was the last directory, the command was not found
+        if (*end == '\0') {
+            break;
+        }
+        path = end + 1;
+    }
+
+    errno = error;
+}
+
+/**
+ * Starts a command in a child process with the given standard streams (-1 inherits the stream).
+ *
+ * Whether the command could be started is reported back over a close-on-exec pipe: if execve succeeds the
+ * pipe is simply closed, and if it fails the child writes its errno into the pipe before exiting. This way
+ * a missing command is an error for the caller rather than an exit status.
+ *
+ * @param unused_fd A descriptor the child has to close before running the command (-1 for none).
+ * @param envp The environment to give the command.
+ *
+ * @return The process ID of the child, or -1 if the command could not be started.
+ */
+static pid_t spawn(const char **args, int in_fd, int out_fd, int err_fd, int unused_fd, char *const *envp,
+                   minishell_status_t *status) {
+    int report[2]; // Declare an array to hold the read and write end of the report pipe
+
+    // If there is no command at all, it cannot be run
+    if (args == NULL || args[0] == NULL) {
+        return fail(status, "empty command", EINVAL);
+    }
+
+    // Attempts to create the report pipe. If the pipe cannot be created,
+    if (pipe2(report, O_CLOEXEC) == -1) {
+        return fail(status, "pipe", errno);
+    }
+
+    pid_t pid = fork(); // Create a new process by forking the current process
+
+    // If this is the child process,
+    if (pid == 0) {
+        close(report[0]); // Close the read end of the report pipe
+
+        // Close the end of a pipe that belongs to the other command
+        if (unused_fd != -1) {
+            close(unused_fd);
+        }
+
+        // Duplicate each given stream onto its standard descriptor
+        if (in_fd != -1) {
+            dup2(in_fd, STDIN_FILENO);
+        }
+        if (out_fd != -1) {
+            dup2(out_fd, STDOUT_FILENO);
+        }
+        if (err_fd != -1) {
+            dup2(err_fd, STDERR_FILENO);
+        }
+
+        // Close the original descriptors so the command does not hold on to them
+        if (in_fd > STDERR_FILENO) {
+            close(in_fd);
+        }
+        if (out_fd > STDERR_FILENO && out_fd != in_fd) {
+            close(out_fd);
+        }
+        if (err_fd > STDERR_FILENO && err_fd != in_fd && err_fd != out_fd) {
+            close(err_fd);
+        }
+
+        // Replace the current process with a new program specified by args[0]
+        exec_command(args, envp);
+
+        // If we get here, execve failed, so report why to the parent and exit
+        int error = errno;
+        if (write(report[1], &error, sizeof(error)) == -1) {
+            _exit(127);
+        }
+        _exit(127);
+    }
+
+    close(report[1]); // Close the write end of the report pipe in the parent process
+
+    // If the child process was not created,
+    if (pid < 0) {
+        close(report[0]);
+        return fail(status, "fork", errno);
+    }
+
+    int error; // Declare a variable to hold the error reported by the child
+    ssize_t length; // Declare a variable to hold the number of bytes read from the report pipe
+
+    // Wait for the child to either start the command or report why it could not
+    do {
+        length = read(report[0], &error, sizeof(error));
+    } while (length == -1 && errno == EINTR);
+    close(report[0]);
+
+    // If the child reported an error, collect it and pass the error on
+    if (length == sizeof(error)) {
+        waitpid(pid, NULL, 0);
+        return fail(status, "execve", error);
+    }
+
+    return pid;
+}
+
+/** Opens the redirection files of a command, reporting failures through the status. */
+static int open_redirections(const char *input_file, const char *output_file, int *input_file_fd,
+                             int *output_file_fd, minishell_status_t *status) {
+    *input_file_fd = -1;
+    *output_file_fd = -1;
+
+    // If there is an input file to handle, attempt to open it
+    if (input_file && (*input_file_fd = open(input_file, O_RDONLY | O_CLOEXEC)) == -1) {
+        return fail(status, "could not open the input file", errno);
+    }
+
+    // If there is an output file to handle, attempt to open it
+    if (output_file && (*output_file_fd = open(output_file, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)) == -1) {
+        int error = errno;
+        if (*input_file_fd != -1) {
+            close(*input_file_fd);
+        }
+        return fail(status, "could not open the output file", error);
+    }
+
+    return 0;
+}
+
+/** Closes the redirection files of a command. */
+static void close_redirections(int input_file_fd, int output_file_fd) {
+    if (input_file_fd != -1) {
+        close(input_file_fd);
+    }
+    if (output_file_fd != -1) {
+        close(output_file_fd);
+    }
+}
+
+// Installs the hooks used by every later call
+void minishell_set_hooks(const minishell_hooks_t *hooks_to_install) {
+    if (hooks_to_install != NULL) {
+        hooks = *hooks_to_install;
+    } else {
+        memset(&hooks, 0, sizeof(hooks));
+    }
+}
+
+/** Runs a command with optional redirections and the given environment, and waits for it to finish. */
+static int execute(const char **args, const char *input_file, const char *output_file, int input_fd,
+                   const minishell_io_t *io, char *const *envp, minishell_status_t *status) {
+    int input_file_fd, output_file_fd; // Declare variables to hold the redirection file descriptors
+
+    // If the redirection files could not be opened, the command cannot be run
+    if (open_redirections(input_file, output_file, &input_file_fd, &output_file_fd, status) != 0) {
+        return -1;
+    }
+
+    // Pick the standard streams of the command, letting redirections override the caller's streams
+    int in_fd = input_file_fd != -1 ? input_file_fd : input_fd != -1 ? input_fd : io ? io->stdin_fd : -1;
+    int out_fd = output_file_fd != -1 ? output_file_fd : io ? io->stdout_fd : -1;
+    int err_fd = io ? io->stderr_fd : -1;
+
+    pid_t pid = spawn(args, in_fd, out_fd, err_fd, -1, envp, status); // Start the command
+    close_redirections(input_file_fd, output_file_fd); // The child has its own copies now
+
+    // If the command could not be started, the status already says why
+    if (pid == -1) {
+        return -1;
+    }
+
+    int wait_status; // Declare a variable to store the exit status of the child process
+
+    // Wait for the child process to complete and store its status
+    if (waitpid(pid, &wait_status, 0) == -1) {
+        return fail(status, "waitpid", errno);
+    }
+
+    record(status, wait_status);
+    return 0;
+}
+
+/** The pipe of a running pipeline, as needed to report its throughput. */
+typedef struct {
+    const pipe_options_t *options; /* How the pipe was set up, including whether to report. */
+    long size;                  /* Capacity of the pipe in bytes. */
+    int direct;                 /* Whether the pipe ended up in packet mode. */
+    int counted;                /* Whether the write counter of the first stage could be read. */
+    unsigned long long bytes;   /* Number of bytes the first stage wrote, an upper bound on what went through the pipe. */
+} pipeline_t;
+
+/**
+ * Waits for a stage of a pipeline to exit. If throughput reporting is on, the stage is left unreaped until its
+ * I/O counters have been read, and its throughput is passed to the on_throughput hook. The bytes reported for
+ * both stages are everything the first stage wrote, which bounds what went through the pipe from above: it
+ * also counts the first stage's writes to standard error or to other files.
+ *
+ * @param start The time the stage was started.
+ */
+static int wait_stage(pid_t pid, int stage, const char *name, const struct timespec *start, pipeline_t *pipeline,
+                      int *wait_status) {
+    if (pipeline->options->report && hooks.on_throughput != NULL) {
+        minishell_throughput_t report; // Declare a structure to hold the throughput of the stage
+        siginfo_t info; // Declare a structure to hold how the stage exited
+        struct timespec end; // Declare a structure to hold the time the stage exited
+
+        // Wait for the stage to exit without reaping it, then note the time
+        while (waitid(P_PID, pid, &info, WEXITED | WNOWAIT) == -1 && errno == EINTR) {
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+
+        // The first stage's standard output is the pipe, so what it wrote is at least what went through the pipe
+        if (stage == 1) {
+            pipeline->counted = pipes_written_bytes(pid, &pipeline->bytes) == 0;
+        }
+
+        // If the write counter could be read, report it
+        if (pipeline->counted) {
+            report.command = name;
+            report.stage = stage;
+            report.bytes = pipeline->bytes;
+            report.seconds = (end.tv_sec - start->tv_sec) + (end.tv_nsec - start->tv_nsec) / 1e9;
+            report.bytes_per_second = report.seconds > 0 ? report.bytes / report.seconds : 0;
+            report.pipe_size = pipeline->size;
+            report.direct = pipeline->direct;
+            hooks.on_throughput(&report);
+        }
+    }
+
+    return waitpid(pid, wait_status, 0);
+}
+
+/** Runs two commands piped together, each with its own environment, and waits for both to finish. */
+static int execute_piped(const char **command_one_args, const char **command_two_args, const char *input_file,
+                         const char *output_file, int input_fd, const minishell_io_t *io, char *const *envp_one,
+                         char *const *envp_two, const pipe_options_t *options, minishell_status_t *status) {
+    int input_file_fd, output_file_fd; // Declare variables to hold the redirection file descriptors
+    int pipefd[2]; // Declare an array to hold the read and write end of the pipe
+    struct timespec start_one, start_two; // Declare structures to hold the time each command was started
+    pipeline_t pipeline = { options, 0, 0, 0, 0 }; // Declare a structure to hold what is known about the pipe
+
+    // If the redirection files could not be opened, the commands cannot be run
+    if (open_redirections(input_file, output_file, &input_file_fd, &output_file_fd, status) != 0) {
+        return -1;
+    }
+
+    pipeline.size = pipes_create(pipefd, options); // Create the pipe with the capacity and mode asked for
+
+    // If the pipe cannot be created,
+    if (pipeline.size == -1) {
+        close_redirections(input_file_fd, output_file_fd);
+        return fail(status, "pipe", errno);
+    }
+    pipeline.direct = (fcntl(pipefd[1], F_GETFL) & O_DIRECT) != 0; // Whether the pipe ended up in packet mode
+
+    // Pick the standard streams of the commands, letting redirections override the caller's streams
+    int in_fd = input_file_fd != -1 ? input_file_fd : input_fd != -1 ? input_fd : io ? io->stdin_fd : -1;
+    int out_fd = output_file_fd != -1 ? output_file_fd : io ? io->stdout_fd : -1;
+    int err_fd = io ? io->stderr_fd : -1;
+
+    // Start the first command, writing into the pipe, and then the second, reading from it
+    clock_gettime(CLOCK_MONOTONIC, &start_one);
+    pid_t command_one_pid = spawn(command_one_args, in_fd, pipefd[1], err_fd, pipefd[0], envp_one, status);
+    pid_t command_two_pid = -1;
+    if (command_one_pid != -1) {
+        clock_gettime(CLOCK_MONOTONIC, &start_two);
+        command_two_pid = spawn(command_two_args, pipefd[0], out_fd, err_fd, pipefd[1], envp_two, status);
+    }
+
+    // Close both ends of the pipe and the redirection files in the parent process
+    close(pipefd[0]);
+    close(pipefd[1]);
+    close_redirections(input_file_fd, output_file_fd);
+
+    int wait_status; // Declare a variable to store the exit status of the child processes
+
+    // Wait for the first command to finish (it sees a broken pipe if the second one could not start)
+    if (command_one_pid != -1) {
+        wait_stage(command_one_pid, 1, command_one_args[0], &start_one, &pipeline, &wait_status);
+    }
+
+    // If one of the commands could not be started, the status already says why
+    if (command_two_pid == -1) {
+        return -1;
+    }
+
+    // Wait for the second command to finish and report its status as the status of the pipeline
+    if (wait_stage(command_two_pid, 2, command_two_args[0], &start_two, &pipeline, &wait_status) == -1) {
+        return fail(status, "waitpid", errno);
+    }
+
+    record(status, wait_status);
+    return 0;
+}
+
+/** The state of a plan while it runs. */
+typedef struct {
+    plan_t *plan;               /* The plan being run. */
+    unsigned int *positions;    /* For each for loop, the index of the word its variable is bound to (0 when not running). */
+    char **values;              /* For each for loop, the expanded word its variable is bound to. */
+    unsigned int loops[PLAN_MAX_NESTING]; /* The for loops that are running, innermost last. */
+    unsigned int loop_count;    /* Number of for loops that are running. */
+    char *scratch;              /* The expanded strings of the command about to run. */
+    size_t scratch_length;      /* Number of bytes of scratch in use. */
+    size_t scratch_capacity;    /* Number of bytes scratch can hold before it has to grow. */
+    const char **pointers;      /* The argument arrays and redirections of the command about to run. */
+    size_t *offsets;            /* For each pointer, the offset of its expanded string in scratch (or SIZE_MAX). */
+    size_t pointer_capacity;    /* Number of entries pointers and offsets can hold. */
+} run_t;
+
+/**
+ * Looks up the value of a variable. The word bound by the innermost for loop with that name comes first,
+ * then the shell variables.
+ */
+static const char *lookup(run_t *run, const char *name, size_t length) {
+    for (unsigned int i = run->loop_count; i > 0; i--) {
+        unsigned int loop = run->loops[i - 1];
+        const char *variable = plan_get(run->plan, loop)->args[0];
+
+        if (strncmp(variable, name, length) == 0 && variable[length] == '\0') {
+            return run->values[loop];
+        }
+    }
+
+    return vars_get(name, length); // The name does not belong to any running loop
+}
+
+/** Appends bytes to the scratch buffer of the run, growing it if needed. */
+static int append_scratch(run_t *run, const char *data, size_t length) {
+
+    // If the buffer is too small (or not allocated yet), double its size until the data fits
+    if (run->scratch == NULL || run->scratch_length + length > run->scratch_capacity) {
+        size_t capacity = run->scratch_capacity ? run->scratch_capacity : 256;
+        while (run->scratch_length + length > capacity) {
+            capacity *= 2;
+        }
+
+        char *grown = (char *)memstats_realloc(MEMSTATS_ENGINE, run->scratch, capacity);
+
+        // If memory could not be allocated, return an error
+        if (grown == NULL) {
+            return 1;
+        }
+
+        run->scratch = grown;
+        run->scratch_capacity = capacity;
+    }
+
+    memcpy(run->scratch + run->scratch_length, data, length); // Copy the data to the end of the buffer
+    run->scratch_length += length; // Update the length of the buffer
+    return 0;
+}
+
+/**
+ * Appends a string to the scratch buffer with every $name and ${name} replaced by the value of the variable.
+ * References to variables that are not set are removed. A '$' that is not followed by a name is kept, and so
+ * is a '$' escaped as "\$". The mark of a quoted token (TOKENS_QUOTED) is dropped.
+ */
+static int expand_string(run_t *run, const char *string) {
+    int result = 0; // Tracks whether memory could be allocated
+
+    string += string[0] == TOKENS_QUOTED; // Skip the mark of a quoted token
+
+    while (result == 0 && *string != '\0') {
+        const char *dollar = strchr(string, '$'); // Find the next reference
+
+        // If there are no more references, copy the rest of the string
+        if (dollar == NULL) {
+            result = append_scratch(run, string, strlen(string));
+            break;
+        }
+
+        // A '$' escaped with a backslash is kept as a plain '$' (without the backslash)
+        if (dollar > string && dollar[-1] == '\\') {
+            result = append_scratch(run, string, dollar - string - 1) || append_scratch(run, "$", 1);
+            string = dollar + 1;
+            continue;
+        }
+
+        result = append_scratch(run, string, dollar - string); // Copy everything in front of the reference
+
+        // Find the name, which is either wrapped in braces or made of letters, digits and underscores
+        int braced = dollar[1] == '{';
+        const char *name = dollar + 1 + braced;
+        size_t length = braced ? strcspn(name, "}") : vars_name_length(name);
+        const char *end = name + length + (braced && name[length] == '}'); // One past the end of the reference
+
+        // Copy the value of the variable (if it is set), or the '$' itself if it is not followed by a name
+        if (length > 0 && (!braced || name[length] == '}')) {
+            const char *value = lookup(run, name, length);
+            if (value != NULL) {
+                result |= append_scratch(run, value, strlen(value));
+            }
+        } else {
+            end = end > dollar + 1 ? end : dollar + 1;
+            result |= append_scratch(run, dollar, end - dollar);
+        }
+
+        string = end; // Continue after the reference
+    }
+
+    return result || append_scratch(run, "", 1); // Null terminate the expanded string
+}
+
+/** Counts the strings of a NULL-terminated array. */
+static unsigned int count_args(const char **args) {
+    unsigned int count = 0;
+    while (args[count] != NULL) {
+        count++;
+    }
+    return count;
+}
+
+/** Grows the pointer and offset arrays of the run so they hold at least count entries. */
+static int reserve_pointers(run_t *run, size_t count) {
+
+    // If the arrays are already large enough, there is nothing to do
+    if (count <= run->pointer_capacity) {
+        return 0;
+    }
+
+    const char **pointers = (const char **)memstats_realloc(MEMSTATS_ENGINE, run->pointers, count * sizeof(char *));
+    if (pointers != NULL) {
+        run->pointers = pointers;
+    }
+    size_t *offsets = (size_t *)memstats_realloc(MEMSTATS_ENGINE, run->offsets, count * sizeof(size_t));
+    if (offsets != NULL) {
+        run->offsets = offsets;
+    }
+
+    // If memory could not be allocated, return an error (the arrays that did grow are kept)
+    if (pointers == NULL || offsets == NULL) {
+        return 1;
+    }
+
+    run->pointer_capacity = count;
+    return 0;
+}
+
+/**
+ * Removes the words of a NULL-terminated argument array that expanded to nothing and were not quoted, the way
+ * "echo $UNSET x" only passes x. The originals tell which words were expanded and which were quoted.
+ */
+static void remove_empty_words(const char **words, const char **originals) {
+    unsigned int kept = 0; // Number of words kept so far
+
+    for (unsigned int i = 0; words[i] != NULL; i++) {
+        if (words[i][0] != '\0' || words[i] == originals[i] || originals[i][0] == TOKENS_QUOTED) {
+            words[kept++] = words[i];
+        }
+    }
+
+    words[kept] = NULL;
+}
+
+/**
+ * Builds a copy of a command with its variables expanded. The copy points into the scratch buffer and
+ * pointer arrays of the run, which are reused for every command. Unquoted words that expand to nothing are
+ * left out.
+ */
+static int expand_command(run_t *run, const plan_command_t *command, plan_command_t *expanded) {
+    unsigned int argc = count_args(command->args);
+    unsigned int piped_argc = command->piped_args ? count_args(command->piped_args) : 0;
+    size_t count = argc + 1 + piped_argc + 1 + 2; // Both argument arrays, then the input and output file
+
+    // Make sure the pointer arrays can hold every string of the command
+    if (reserve_pointers(run, count) != 0) {
+        return 1;
+    }
+
+    // Gather every string of the command into the pointer array, in the order described above
+    const char **pointers = run->pointers;
+    memcpy(pointers, command->args, (argc + 1) * sizeof(char *));
+    if (command->piped_args) {
+        memcpy(pointers + argc + 1, command->piped_args, (piped_argc + 1) * sizeof(char *));
+    } else {
+        pointers[argc + 1] = NULL;
+    }
+    pointers[count - 2] = command->input_file;
+    pointers[count - 1] = command->output_file;
+
+    // Expand every string that refers to a variable, remembering where its expansion starts
+    run->scratch_length = 0;
+    for (size_t i = 0; i < count; i++) {
+        run->offsets[i] = SIZE_MAX;
+        if (pointers[i] != NULL && strchr(pointers[i], '$') != NULL) {
+            run->offsets[i] = run->scratch_length;
+            if (expand_string(run, pointers[i]) != 0) {
+                return 1;
+            }
+        }
+    }
+
+    // Now that the scratch buffer no longer moves, point at the expanded strings
+    for (size_t i = 0; i < count; i++) {
+        if (run->offsets[i] != SIZE_MAX) {
+            pointers[i] = run->scratch + run->offsets[i];
+        }
+    }
+
+    // Leave out the words that expanded to nothing
+    remove_empty_words(pointers, command->args);
+    if (command->piped_args) {
+        remove_empty_words(pointers + argc + 1, command->piped_args);
+    }
+
+    *expanded = *command;
+    expanded->args = pointers;
+    expanded->piped_args = command->piped_args ? pointers + argc + 1 : NULL;
+    expanded->input_file = pointers[count - 2];
+    expanded->output_file = pointers[count - 1];
+    return 0;
+}
+
+/** Counts the NAME=value assignments in front of a command. */
+static unsigned int count_assignments(const char **args) {
+    unsigned int count = 0;
+    size_t length; // Declare a variable to hold the length of the name being assigned
+
+    while (args[count] != NULL && (length = vars_name_length(args[count])) > 0 && args[count][length] == '=') {
+        count++;
+    }
+    return count;
+}
+
+/** Finds the built-in command with the given name in a table, or returns NULL. */
+static const minishell_builtin_t *find_builtin(const minishell_builtin_t *table, const char *name) {
+    for (unsigned int i = 0; table != NULL && table[i].name != NULL; i++) {
+        if (strcmp(name, table[i].name) == 0) {
+            return &table[i];
+        }
+    }
+    return NULL;
+}
+
+/** The export built-in command, which sets and exports each NAME=value argument and exports each NAME argument. */
+static int export_builtin(const char **args, const char *input_file, const char *output_file, int input_fd) {
+    int result = 0; // Tracks whether any argument was not valid
+
+    for (unsigned int i = 1; args[i] != NULL; i++) {
+        size_t length = vars_name_length(args[i]);
+
+        if (length == 0 || (args[i][length] != '=' && args[i][length] != '\0')) {
+            result = 1; // The argument does not start with a name
+        } else if (args[i][length] == '=') {
+            result |= vars_assign(args[i], 1);
+        } else {
+            vars_export(args[i], length);
+        }
+    }
+
+    return result;
+}
+
+/** The unset built-in command, which removes each variable named by its arguments. */
+static int unset_builtin(const char **args, const char *input_file, const char *output_file, int input_fd) {
+    int result = 0; // Tracks whether any argument was not valid
+
+    for (unsigned int i = 1; args[i] != NULL; i++) {
+        size_t length = vars_name_length(args[i]);
+
+        if (length == 0 || args[i][length] != '\0') {
+            result = 1; // The argument is not a name
+        } else {
+            vars_unset(args[i], length);
+        }
+    }
+
+    return result;
+}
+
+// Built-in commands that manage the shell variables, looked up after the ones installed by the caller
+static const minishell_builtin_t variable_builtins[] = {
+    { "export", export_builtin },
+    { "unset", unset_builtin },
+    { NULL, NULL }
+};
+
+/** Finds the value of a setting among the NAME=value assignments in front of a command, or returns NULL. */
+static const char *assigned(const char **args, unsigned int count, const char *name) {
+    size_t length = strlen(name);
+
+    for (unsigned int i = 0; i < count; i++) {
+        if (strncmp(args[i], name, length) == 0 && args[i][length] == '=') {
+            return args[i] + length + 1;
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Reads the pipe settings of a pipeline (see pipes.h). Assignments in front of either command of the pipeline
+ * come before the shell variables.
+ */
+static void read_pipe_options(const char **args, unsigned int assignments, const char **piped_args,
+                              unsigned int piped_assignments, pipe_options_t *options) {
+    const char *names[] = { "MINISHELL_PIPE_SIZE", "MINISHELL_PIPE_DIRECT", "MINISHELL_PIPE_REPORT" };
+    const char *values[3]; // Declare an array to hold the value of each setting
+
+    for (unsigned int i = 0; i < 3; i++) {
+        values[i] = assigned(args, assignments, names[i]);
+        values[i] = values[i] ? values[i] : assigned(piped_args, piped_assignments, names[i]);
+        values[i] = values[i] ? values[i] : vars_lookup(names[i]);
+    }
+
+    options->size = pipes_parse_size(values[0]);
+    options->direct = values[1] != NULL && strcmp(values[1], "1") == 0;
+    options->report = values[2] != NULL && strcmp(values[2], "1") == 0;
+}
+
+// Runs a command with optional redirections and waits for it to finish
+int minishell_execute(const char **args, const char *input_file, const char *output_file, int input_fd,
+                      const minishell_io_t *io, minishell_status_t *status) {
+    char *const *envp = vars_environ(); // The environment of the exported variables
+
+    // If the environment could not be built, the command cannot be run
+    if (envp == NULL) {
+        return fail(status, "environment", ENOMEM);
+    }
+
+    return execute(args, input_file, output_file, input_fd, io, envp, status);
+}
+
+// Runs two commands with the output of the first piped into the second, and waits for both to finish
+int minishell_execute_piped(const char **command_one_args, const char **command_two_args, const char *input_file,
+                            const char *output_file, int input_fd, const minishell_io_t *io,
+                            minishell_status_t *status) {
+    char *const *envp = vars_environ(); // The environment of the exported variables
+    pipe_options_t options; // Declare a structure to hold the pipe settings of the shell
+
+    // If the environment could not be built, the commands cannot be run
+    if (envp == NULL) {
+        return fail(status, "environment", ENOMEM);
+    }
+
+    read_pipe_options(NULL, 0, NULL, 0, &options);
+    return execute_piped(command_one_args, command_two_args, input_file, output_file, input_fd, io, envp, envp,
+                         &options, status);
+}
+
+/**
+ * Runs a single command with its variables expanded and its assignments applied. A command made only of
+ * assignments sets shell variables, and assignments in front of a command only go into its environment.
+ */
+static int run_command(run_t *run, const plan_command_t *command, const minishell_io_t *io,
+                       minishell_status_t *status) {
+    plan_command_t expanded; // Declare a structure to hold the command with its variables expanded
+    int input_fd = -1; // Set the here-document file descriptor to none
+    int result; // Declare a variable to hold the result of running the command
+    const minishell_builtin_t *builtin = NULL; // The built-in command to run, if any
+    char **envp_one = NULL, **envp_two = NULL; // The one-off environments of commands preceded by assignments
+
+    // If the command refers to variables, expand them first
+    if (command->has_variables) {
+        if (expand_command(run, command, &expanded) != 0) {
+            return fail(status, "expand", ENOMEM);
+        }
+        command = &expanded;
+    }
+
+    unsigned int assignments = count_assignments(command->args);
+    unsigned int piped_assignments = command->piped_args ? count_assignments(command->piped_args) : 0;
+    const char **args = command->args + assignments; // The command itself, after its assignments
+
+    // If the command only assigns variables (or all of its words expanded to nothing), set them in the shell
+    if (args[0] == NULL && command->piped_args == NULL) {
+        record(status, 0);
+        for (unsigned int i = 0; i < assignments; i++) {
+            if (vars_assign(command->args[i], 0) != 0) {
+                return fail(status, "assign", ENOMEM);
+            }
+        }
+        return 0;
+    }
+
+    // If a command of the pipeline is left without words, there is nothing to run on that side of the pipe
+    if (command->piped_args != NULL && (args[0] == NULL || command->piped_args[piped_assignments] == NULL)) {
+        return fail(status, "pipe", EINVAL);
+    }
+
+    // If the command is not piped, look for a built-in command with its name
+    if (command->piped_args == NULL && args[0] != NULL) {
+        builtin = find_builtin(hooks.builtins, args[0]);
+        builtin = builtin ? builtin : find_builtin(variable_builtins, args[0]);
+    }
+
+    char *const *envp = builtin ? NULL : vars_environ(); // The environment of the exported variables
+
+    // If the command is run in a child process, it needs an environment
+    if (builtin == NULL) {
+        if (envp == NULL || (assignments > 0 && (envp_one = vars_environ_with(command->args, assignments)) == NULL)
+            || (piped_assignments > 0
+                && (envp_two = vars_environ_with(command->piped_args, piped_assignments)) == NULL)) {
+            memstats_free(envp_one);
+            return fail(status, "environment", ENOMEM);
+        }
+    }
+
+    // If the command reads a here-document or here-string, turn its contents into a file descriptor
+    if (command->here_data != NULL && (input_fd = make_input_fd(command->here_data, command->here_length)) == -1) {
+        memstats_free(envp_one);
+        memstats_free(envp_two);
+        return fail(status, "here-document", errno);
+    }
+
+    // If the command is a built-in command, run it inside this process with its assignments in effect
+    if (builtin != NULL) {
+        unsigned int outer_count; // Declare a variable to hold the number of assignments of an outer built-in
+        const char **outer = vars_assignments(&outer_count);
+
+        vars_set_assignments(command->args, assignments);
+        record(status, 0);
+        status->exit_status = builtin->run(args, command->input_file, command->output_file, input_fd);
+        vars_set_assignments(outer, outer_count);
+        result = 0;
+    }
+
+    // If the command is piped into a second command, set up the pipe as the pipeline asks
+    else if (command->piped_args != NULL) {
+        pipe_options_t options; // Declare a structure to hold the pipe settings of the pipeline
+        read_pipe_options(command->args, assignments, command->piped_args, piped_assignments, &options);
+        result = execute_piped(args, command->piped_args + piped_assignments, command->input_file,
+                               command->output_file, input_fd, io, envp_one ? envp_one : envp,
+                               envp_two ? envp_two : envp, &options, status);
+    }
+
+    // Otherwise, run the command on its own
+    else {
+        result = execute(args, command->input_file, command->output_file, input_fd, io,
+                         envp_one ? envp_one : envp, status);
+    }
+
+    // Close the here-document file descriptor now that the command has read it
+    if (input_fd != -1) {
+        close(input_fd);
+    }
+
+    memstats_free(envp_one);
+    memstats_free(envp_two);
+    return result;
+}
+
+// Runs a single command of a parsed plan, including its pipe, redirections and here-document
+int minishell_run_command(const plan_command_t *command, const minishell_io_t *io, minishell_status_t *status) {
+    run_t run; // Declare a structure to hold the scratch space of the expansion (there are no loops)
+
+    memset(&run, 0, sizeof(run));
+    int result = run_command(&run, command, io, status);
+
+    // Free the scratch space of the expansion
+    memstats_free(run.scratch);
+    memstats_free(run.pointers);
+    memstats_free(run.offsets);
+
+    return result;
+}
+
+/** Runs a command of the plan with its variables expanded, reporting a command that could not be run. */
+static int run_expanded(run_t *run, const plan_command_t *command, const minishell_io_t *io, minishell_status_t *status) {
+
+    // Run the command. If it could not be run, let the caller know
+    if (run_command(run, command, io, status) != 0) {
+        if (hooks.on_error != NULL) {
+            hooks.on_error(status);
+        }
+        return -1;
+    }
+
+    return 0;
+}
+
+/** Moves a for loop to its next word. Returns 1 if the variable was bound, 0 if the loop is finished. */
+static int step_loop(run_t *run, unsigned int index) {
+    const plan_command_t *command = plan_get(run->plan, index);
+    unsigned int next = run->positions[index] + 1; // The index of the next word (words start at args[1])
+
+    memstats_free(run->values[index]);
+    run->values[index] = NULL;
+
+    // If there are no words left, the loop is finished
+    if (command->args[next - 1] == NULL || command->args[next] == NULL) {
+        if (run->positions[index] != 0) {
+            run->loop_count--;
+        }
+        run->positions[index] = 0;
+        return 0;
+    }
+
+    // If the loop is just starting, it becomes the innermost running loop. A plan is checked for its nesting
+    // when it is loaded, so running out of room means it is broken: the loop is skipped rather than overflowing
+    if (run->positions[index] == 0) {
+        if (run->loop_count == PLAN_MAX_NESTING) {
+            return 0;
+        }
+        run->loops[run->loop_count++] = index;
+    }
+    run->positions[index] = next;
+
+    // Bind the variable to the word, expanding any variables the word itself refers to
+    run->scratch_length = 0;
+    if (strchr(command->args[next], '$') != NULL && expand_string(run, command->args[next]) == 0) {
+        run->values[index] = memstats_strdup(MEMSTATS_ENGINE, run->scratch);
+    } else {
+        run->values[index] = memstats_strdup(MEMSTATS_ENGINE, command->args[next]);
+    }
+
+    return 1;
+}
+
+// Runs the commands of a parsed plan, following its for, while and if blocks
+int minishell_run_plan(plan_t *plan, const minishell_io_t *io, minishell_status_t *status) {
+    run_t run; // Declare a structure to hold the state of the plan while it runs
+    int result = 0; // Tracks whether any command could not be run
+    unsigned int count = plan_size(plan); // The number of commands in the plan
+
+    memset(&run, 0, sizeof(run));
+    run.plan = plan;
+    run.positions = (unsigned int *)memstats_calloc(MEMSTATS_ENGINE, count + 1, sizeof(unsigned int));
+    run.values = (char **)memstats_calloc(MEMSTATS_ENGINE, count + 1, sizeof(char *));
+
+    // If memory could not be allocated, nothing is run
+    if (run.positions == NULL || run.values == NULL) {
+        memstats_free(run.positions);
+        memstats_free(run.values);
+        return fail(status, "run", ENOMEM);
+    }
+
+    // An empty plan succeeds without running anything
+    record(status, 0);
+
+    // Run the commands, following the jumps of the control flow
+    for (unsigned int i = 0; i < count;) {
+        const plan_command_t *command = plan_get(plan, i);
+
+        switch (command->kind) {
+
+            // A for loop binds its variable and enters the body, or jumps past the loop when it is finished
+            case PLAN_FOR:
+                i = step_loop(&run, i) ? i + 1 : command->target;
+                break;
+
+            // A condition enters the block if the command succeeds, and jumps past it otherwise
+            case PLAN_IF:
+            case PLAN_WHILE:
+                if (run_expanded(&run, command, io, status) != 0) {
+                    result = -1;
+                }
+                i = status->error == 0 && status->exit_status == 0 ? i + 1 : command->target;
+                break;
+
+            // The end of a loop or of the first branch of an if jumps without running anything
+            case PLAN_ELSE:
+            case PLAN_DONE:
+                i = command->target;
+                break;
+
+            // Anything else is a plain command
+            default:
+                if (run_expanded(&run, command, io, status) != 0) {
+                    result = -1;
+                }
+                i++;
+                break;
+        }
+    }
+
+    // Free the state of the run
+    for (unsigned int i = 0; i < count; i++) {
+        memstats_free(run.values[i]);
+    }
+    memstats_free(run.values);
+    memstats_free(run.positions);
+    memstats_free(run.scratch);
+    memstats_free(run.pointers);
+    memstats_free(run.offsets);
+
+    return result;
+}
+
+// Parses and runs a command line
+int minishell_run_line(const char *line, const minishell_io_t *io, minishell_status_t *status) {
+    plan_t *plan = plan_compile(line); // Parse the line into a plan
+
+    // If the line could not be parsed, nothing is run
+    if (plan == NULL) {
+        return fail(status, "parse", errno);
+    }
+
+    int result = minishell_run_plan(plan, io, status); // Run the commands of the line
+    plan_close(plan); // Free the plan
+    return result;
+}
+
+/** A command started by minishell_parallel. */
+typedef struct {
+    pid_t pid;                  /* Process ID of the command, or -1 if the slot is free. */
+    int pidfd;                  /* Descriptor that becomes readable when the command exits, or -1. */
+    int output_fd;              /* In-memory file collecting the output of the command when it is grouped, or -1. */
+} job_t;
+
+/**
+ * Builds the arguments of one job in the scratch space of the run: every {} is replaced by the item, and if
+ * there is no {} at all, the item is added as the last argument.
+ */
+static const char **build_job(run_t *run, const char **args, const char *item) {
+    unsigned int argc = count_args(args);
+    size_t count = argc + 2; // The arguments, the item if it is added at the end, and the terminating NULL
+    int substituted = 0; // Tracks whether any {} was found
+
+    // Make sure the pointer arrays can hold every argument
+    if (reserve_pointers(run, count) != 0) {
+        return NULL;
+    }
+
+    // Copy each argument into the scratch buffer with its {} replaced, remembering where it starts
+    run->scratch_length = 0;
+    for (unsigned int i = 0; i < argc; i++) {
+        const char *string = args[i];
+        const char *braces;
+
+        run->offsets[i] = run->scratch_length;
+        while ((braces = strstr(string, "{}")) != NULL) {
+            if (append_scratch(run, string, braces - string) || append_scratch(run, item, strlen(item))) {
+                return NULL;
+            }
+            string = braces + 2;
+            substituted = 1;
+        }
+        if (append_scratch(run, string, strlen(string) + 1)) {
+            return NULL;
+        }
+    }
+
+    // If there was no {}, the item becomes the last argument
+    run->offsets[argc] = run->scratch_length;
+    if (!substituted && append_scratch(run, item, strlen(item) + 1)) {
+        return NULL;
+    }
+
+    // Now that the scratch buffer no longer moves, point at the arguments
+    for (unsigned int i = 0; i < argc + !substituted; i++) {
+        run->pointers[i] = run->scratch + run->offsets[i];
+    }
+    run->pointers[argc + !substituted] = NULL;
+
+    return run->pointers;
+}
+
+/** Copies everything a grouped job wrote into its in-memory file to the output, in one piece. */
+static void flush_job_output(int output_fd, int out_fd) {
+    char buffer[65536]; // Declare a buffer to hold each chunk of the output
+    ssize_t length; // Declare a variable to hold the number of bytes read
+
+    lseek(output_fd, 0, SEEK_SET);
+    while ((length = read(output_fd, buffer, sizeof(buffer))) > 0) {
+        for (ssize_t written = 0, count; written < length; written += count) {
+            if ((count = write(out_fd, buffer + written, length - written)) <= 0) {
+                return;
+            }
+        }
+    }
+}
+
+/**
+ * Waits for one of the running jobs to exit and returns its slot. The pidfds of the jobs are polled so that
+ * whichever job exits first is picked up. Without pidfds, the first running job is waited for.
+ */
+static unsigned int wait_any_job(job_t *jobs, unsigned int job_count, struct pollfd *pollfds) {
+    unsigned int polled = 0; // Number of running jobs that have a pidfd
+    unsigned int first = job_count; // The first running job
+
+    for (unsigned int i = 0; i < job_count; i++) {
+        if (jobs[i].pid != -1) {
+            first = first < job_count ? first : i;
+            if (jobs[i].pidfd == -1) {
+                return first; // Fall back to waiting for the first running job
+            }
+            pollfds[polled].fd = jobs[i].pidfd;
+            pollfds[polled].events = POLLIN;
+            polled++;
+        }
+    }
+
+    // Wait until at least one job exits, then find its slot
+    while (poll(pollfds, polled, -1) == -1 && errno == EINTR) {
+    }
+    for (unsigned int p = 0; p < polled; p++) {
+        if (pollfds[p].revents != 0) {
+            for (unsigned int i = 0; i < job_count; i++) {
+                if (jobs[i].pid != -1 && jobs[i].pidfd == pollfds[p].fd) {
+                    return i;
+                }
+            }
+        }
+    }
+
+    return first;
+}
+
+// Runs a command once for each line read from a stream, keeping up to the given number of them running
+int minishell_parallel(const char **args, FILE *items, unsigned int job_count, int group, const minishell_io_t *io,
+                       minishell_status_t *status) {
+    run_t run; // Declare a structure to hold the scratch space the arguments of each job are built in
+    char *line = NULL; // Declare a pointer to hold each item read
+    size_t line_capacity = 0; // Declare a variable to hold the size of the line buffer
+    unsigned int running = 0; // Number of jobs that are running
+    unsigned int failed = 0; // Number of jobs that did not succeed
+    int result = 0; // Tracks whether any job could not be run
+    int reading = 1; // Whether there may be more items to read
+    int read_error = 0; // The error that stopped the items from being read, or 0
+
+    // If no number of jobs was given, run one per processor
+    if (job_count == 0) {
+        long processors = sysconf(_SC_NPROCESSORS_ONLN);
+        job_count = processors > 0 ? (unsigned int)processors : 1;
+    }
+
+    // Every slot is allocated up front, so never ask for more than could ever run at once
+    struct rlimit processes; // Declare a structure to hold the process limit of the user
+    if (job_count > MINISHELL_MAX_JOBS) {
+        job_count = MINISHELL_MAX_JOBS;
+    }
+    if (getrlimit(RLIMIT_NPROC, &processes) == 0 && processes.rlim_cur != RLIM_INFINITY
+        && job_count > processes.rlim_cur) {
+        job_count = processes.rlim_cur > 0 ? (unsigned int)processes.rlim_cur : 1;
+    }
+
+    char *const *envp = vars_environ(); // The environment of the exported variables
+    job_t *jobs = (job_t *)memstats_malloc(MEMSTATS_ENGINE, job_count * sizeof(job_t));
+    struct pollfd *pollfds = (struct pollfd *)memstats_malloc(MEMSTATS_ENGINE, job_count * sizeof(struct pollfd));
+    int null_fd = open("/dev/null", O_RDONLY | O_CLOEXEC); // Jobs must not read the items meant for other jobs
+
+    // If anything needed to run the jobs could not be set up, nothing is run
+    if (envp == NULL || jobs == NULL || pollfds == NULL || null_fd == -1) {
+        int error = null_fd == -1 ? errno : ENOMEM;
+        memstats_free(jobs);
+        memstats_free(pollfds);
+        if (null_fd != -1) {
+            close(null_fd);
+        }
+        return fail(status, "parallel", error);
+    }
+
+    memset(&run, 0, sizeof(run));
+    for (unsigned int i = 0; i < job_count; i++) {
+        jobs[i].pid = -1;
+    }
+
+    int out_fd = io ? io->stdout_fd : -1;
+    int err_fd = io ? io->stderr_fd : -1;
+
+    // Keep every slot busy until the items run out, then wait for the jobs that are left
+    while (reading || running > 0) {
+
+        // While a slot is free, start the next item in it
+        while (reading && running < job_count) {
+            ssize_t length = getline(&line, &line_capacity, items); // Read the next item
+
+            // If there are no more items, stop starting jobs
+            if (length == -1) {
+                read_error = ferror(items) ? errno : 0;
+                reading = 0;
+                break;
+            }
+
+            // Remove the newline at the end of the item, and skip empty items
+            line[strcspn(line, "\n")] = '\0';
+            if (line[0] == '\0') {
+                continue;
+            }
+
+            // Find a free slot (there is one, as fewer jobs than slots are running)
+            unsigned int slot = 0;
+            while (jobs[slot].pid != -1) {
+                slot++;
+            }
+
+            minishell_status_t job_status; // Declare a structure to hold why the job could not be started
+            const char **job_args = build_job(&run, args, line);
+            int output_fd = group ? memfd_create("parallel", MFD_CLOEXEC) : -1;
+
+            // Start the job, sending its output to its in-memory file if the output is grouped
+            pid_t pid = -1;
+            if (job_args == NULL) {
+                fail(&job_status, "parallel", ENOMEM);
+            } else if (group && output_fd == -1) {
+                fail(&job_status, "memfd_create", errno);
+            } else {
+                pid = spawn(job_args, null_fd, group ? output_fd : out_fd, err_fd, -1, envp, &job_status);
+            }
+
+            // If the job could not be started, let the caller know and move on to the next item
+            if (pid == -1) {
+                if (output_fd != -1) {
+                    close(output_fd);
+                }
+                if (hooks.on_error != NULL) {
+                    hooks.on_error(&job_status);
+                }
+                failed++;
+                result = -1;
+                continue;
+            }
+
+            jobs[slot].pid = pid;
+            jobs[slot].output_fd = output_fd;
+#ifdef SYS_pidfd_open
+            jobs[slot].pidfd = (int)syscall(SYS_pidfd_open, pid, 0);
+#else
+            jobs[slot].pidfd = -1;
+#endif
+            running++;
+        }
+
+        // If no job is running, there is nothing to wait for
+        if (running == 0) {
+            continue;
+        }
+
+        // Wait for a job to exit, freeing its slot for the next item
+        unsigned int slot = wait_any_job(jobs, job_count, pollfds);
+        int wait_status; // Declare a variable to store the exit status of the job
+
+        if (waitpid(jobs[slot].pid, &wait_status, 0) == -1 || !WIFEXITED(wait_status)
+            || WEXITSTATUS(wait_status) != 0) {
+            failed++;
+        }
+
+        // If the output of the job was collected, write it out now that the job is done
+        if (jobs[slot].output_fd != -1) {
+            flush_job_output(jobs[slot].output_fd, out_fd != -1 ? out_fd : STDOUT_FILENO);
+            close(jobs[slot].output_fd);
+        }
+        if (jobs[slot].pidfd != -1) {
+            close(jobs[slot].pidfd);
+        }
+        jobs[slot].pid = -1;
+        running--;
+    }
+
+    // Free everything used to run the jobs
+    free(line);
+    close(null_fd);
+    memstats_free(jobs);
+    memstats_free(pollfds);
+    memstats_free(run.scratch);
+    memstats_free(run.pointers);
+    memstats_free(run.offsets);
+
+    // If the items could not be read to the end, say why
+    if (read_error != 0) {
+        return fail(status, "read", read_error);
+    }
+
+    // Like GNU parallel, the exit status is the number of jobs that failed (at most 101)
+    record(status, 0);
+    status->exit_status = failed < 101 ? (int)failed : 101;
+    return result;
+}
@@ -0,0 +1,186 @@
+// A header file that declares the embeddable mini-shell library
+//
+// The library is made up of every source file except shell.c (the interactive front end) and tokenize.c
+// (the tokenizer demo). It can be built as a static or shared library, for example:
+//
+//   cc -c -fPIC memstats.c vect.c tokens.c heredoc.c cache.c plan.c vars.c pipes.c minishell.c
+//   ar rcs libminishell.a memstats.o vect.o tokens.o heredoc.o cache.o plan.o vars.o pipes.o minishell.o
+//   cc -shared -o libminishell.so memstats.o vect.o tokens.o heredoc.o cache.o plan.o vars.o pipes.o minishell.o
+//
+// None of the functions below print anything or exit the calling process. Failures are reported through
+// the return value and the status structure.
+//
+// Commands are started with execve and the environment of the exported shell variables (see vars.h), which
+// start out as a copy of the caller's environment.
+
+#ifndef _MINISHELL_H
+#define _MINISHELL_H
+
+#include <stdio.h>
+
+#include "plan.h"
+
+#define MINISHELL_MAX_JOBS 4096 // Most commands minishell_parallel keeps running at once, whatever is asked for
+
+/** The standard streams given to the commands that are run. A value of -1 inherits the caller's stream. */
+typedef struct {
+    int stdin_fd;               /* Standard input of the first command of a pipeline. */
+    int stdout_fd;              /* Standard output of the last command of a pipeline. */
+    int stderr_fd;              /* Standard error of every command. */
+} minishell_io_t;
+
+/** The outcome of running a command (for pipelines, the last command). */
+typedef struct {
+    int exit_status;            /* Exit status of the command, or -1 if it did not exit normally or did not run. */
+    int signal;                 /* Signal that terminated the command, or 0. */
+    int error;                  /* errno value describing why the command could not be run, or 0. */
+    const char *stage;          /* Short description of the step that failed (such as "fork"), or NULL. */
+} minishell_status_t;
+
+/** A built-in command, run inside the calling process instead of in a child process. */
+typedef struct {
+    const char *name;           /* Name the command is invoked by. */
+    int (*run)(const char **args, const char *input_file, const char *output_file, int input_fd);
+                                /* Runs the command (args[0] is its name) and returns its exit status. */
+} minishell_builtin_t;
+
+/** The throughput of one stage of a pipeline, reported when MINISHELL_PIPE_REPORT is set (see pipes.h). */
+typedef struct {
+    const char *command;        /* Name of the command of the stage. */
+    int stage;                  /* 1 for the command writing into the pipe, 2 for the command reading from it. */
+    unsigned long long bytes;   /* Upper bound on the bytes sent through the pipe: every byte stage 1 wrote (its
+                                   wchar counter), which also counts its writes to standard error and other
+                                   files. Stage 2 reports the same number, as what it read is not measured. */
+    double seconds;             /* Time from starting the stage until it exited. */
+    double bytes_per_second;    /* Bytes divided by seconds. */
+    long pipe_size;             /* Capacity of the pipe in bytes. */
+    int direct;                 /* Whether the pipe was in packet mode (O_DIRECT). */
+} minishell_throughput_t;
+
+/** Ways for the caller to extend the library. */
+typedef struct {
+    const minishell_builtin_t *builtins; /* Built-in commands, ending with an entry whose name is NULL (can be NULL). */
+    void (*on_error)(const minishell_status_t *status); /* Called for each command of a plan that could not be run (can be NULL). */
+    void (*on_throughput)(const minishell_throughput_t *report); /* Called for each stage of a reported pipeline (can be NULL). */
+} minishell_hooks_t;
+
+/**
+ * Installs the hooks used by every later call. Built-in commands are matched by name for commands that are
+ * not piped, in minishell_run_command and everything built on it. The caller's built-in commands come
+ * before the ones of the library (export and unset).
+ *
+ * @param hooks The hooks to install (copied), or NULL to remove them.
+ */
+void minishell_set_hooks(const minishell_hooks_t *hooks);
+
+/**
+ * Runs a command with optional redirections and waits for it to finish.
+ *
+ * Redirections take precedence over the caller's streams: input_file over input_fd over io->stdin_fd, and
+ * output_file over io->stdout_fd. Files are opened by the library before the command is started, so a
+ * missing input file is reported as an error rather than as a failing command.
+ *
+ * @param args A NULL-terminated array holding the command and its arguments.
+ * @param input_file A file to redirect standard input from (can be NULL for no redirection).
+ * @param output_file A file to redirect standard output to (can be NULL for no redirection).
+ * @param input_fd A file descriptor to use as standard input, such as a here-document (-1 for none).
+ * @param io The streams to give the command (can be NULL to inherit all of them).
+ * @param status A pointer to where the outcome of the command will be stored.
+ *
+ * @return 0 if the command ran (whatever its exit status), -1 if it could not be run.
+ */
+int minishell_execute(const char **args, const char *input_file, const char *output_file, int input_fd,
+                      const minishell_io_t *io, minishell_status_t *status);
+
+/**
+ * Runs two commands with the output of the first piped into the second, and waits for both to finish.
+ * Input redirections apply to the first command and output redirections to the second. The pipe is set up
+ * according to the pipe settings in the shell variables (see pipes.h).
+ *
+ * @param command_one_args A NULL-terminated array holding the first command and its arguments.
+ * @param command_two_args A NULL-terminated array holding the second command and its arguments.
+ * @param input_file A file to redirect standard input from (can be NULL for no redirection).
+ * @param output_file A file to redirect standard output to (can be NULL for no redirection).
+ * @param input_fd A file descriptor to use as the standard input of the first command (-1 for none).
+ * @param io The streams to give the commands (can be NULL to inherit all of them).
+ * @param status A pointer to where the outcome of the second command will be stored.
+ *
+ * @return 0 if both commands ran (whatever their exit status), -1 if one of them could not be run.
+ */
+int minishell_execute_piped(const char **command_one_args, const char **command_two_args, const char *input_file,
+                            const char *output_file, int input_fd, const minishell_io_t *io,
+                            minishell_status_t *status);
+
+/**
+ * Runs a single command of a parsed plan, including its pipe, redirections and here-document.
+ *
+ * If the command refers to variables ($name or ${name}), they are expanded first. Assignments of the form
+ * NAME=value in front of a command only go into the environment of that command (for a built-in command,
+ * into the environment of every command it starts, see vars_set_assignments), while a command made only
+ * of assignments sets shell variables. Pipe settings assigned in front of either command of a pipeline apply
+ * to that pipeline only.
+ *
+ * @param command The command to run.
+ * @param io The streams to give the command (can be NULL to inherit all of them).
+ * @param status A pointer to where the outcome of the command will be stored.
+ *
+ * @return 0 if the command ran (whatever its exit status), -1 if it could not be run.
+ */
+int minishell_run_command(const plan_command_t *command, const minishell_io_t *io, minishell_status_t *status);
+
+/**
+ * Runs the commands of a parsed plan, following its for, while and if blocks. A command that cannot be run
+ * is reported to the on_error hook and does not stop the ones after it, just like in a sourced script. A
+ * condition that cannot be run counts as false.
+ *
+ * Variables ($name or ${name}) are expanded right before the command runs. The variable of a running for
+ * loop hides a shell variable with the same name, and references to variables that are not set are removed.
+ * A word that expands to nothing is left out unless it was quoted.
+ *
+ * @param plan The plan to run, as returned by plan_open or plan_compile.
+ * @param io The streams to give the commands (can be NULL to inherit all of them).
+ * @param status A pointer to where the outcome of the last command will be stored.
+ *
+ * @return 0 if every command ran, -1 if at least one of them could not be run.
+ */
+int minishell_run_plan(plan_t *plan, const minishell_io_t *io, minishell_status_t *status);
+
+/**
+ * Parses and runs a command line. The line may hold several commands separated by ';' or newlines, pipes,
+ * redirections, here-strings, here-documents whose bodies follow on the next lines, and for, while and if
+ * blocks.
+ *
+ * @param line The command line to run.
+ * @param io The streams to give the commands (can be NULL to inherit all of them).
+ * @param status A pointer to where the outcome of the last command will be stored.
+ *
+ * @return 0 if every command ran, -1 if the line could not be parsed or a command could not be run.
+ */
+int minishell_run_line(const char *line, const minishell_io_t *io, minishell_status_t *status);
+
+/**
+ * Runs a command once for each line read from a stream, keeping up to job_count of them running at once. The
+ * lines form a work queue: whenever a command exits, the next line is started in its place, so a slow item
+ * never holds up the others. Empty lines are skipped.
+ *
+ * Every {} in the arguments is replaced by the line, and if there is no {} at all, the line is added as the
+ * last argument. Each command is started directly (no /bin/sh in between), with its standard input reading
+ * from /dev/null. A command that cannot be started is reported to the on_error hook and counts as failed.
+ *
+ * @param args A NULL-terminated array holding the command and its arguments.
+ * @param items The stream to read the lines from.
+ * @param job_count The largest number of commands running at once, or 0 for one per online processor. It is
+ *                  capped at MINISHELL_MAX_JOBS and at the process limit of the user (RLIMIT_NPROC), as every
+ *                  running command needs a slot.
+ * @param group Whether the output of each command is collected in memory and written out in one piece when the
+ *              command exits, so that the output of different commands never interleaves.
+ * @param io The streams to give the commands (the standard input is ignored, and can be NULL to inherit all of them).
+ * @param status A pointer to where the outcome will be stored. Its exit status is the number of commands that
+ *               failed (at most 101).
+ *
+ * @return 0 if every command ran, -1 if at least one of them could not be run or the lines could not be read.
+ */
+int minishell_parallel(const char **args, FILE *items, unsigned int job_count, int group, const minishell_io_t *io,
+                       minishell_status_t *status);
+
+#endif
@@ -0,0 +1,115 @@
+// A source file that defines the pipes connecting the two commands of a pipeline
+
+#define _GNU_SOURCE // Needed for pipe2, O_DIRECT and F_SETPIPE_SZ
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <limits.h>
+
+#include "pipes.h"
+
+#define PIPES_DEFAULT_MAX_SIZE (1024 * 1024) // The kernel's default pipe-max-size limit (1 MiB)
+
+// Reads the largest capacity an unprivileged process can give a pipe
+long pipes_max_size() {
+    static long max_size = 0; // The limit, once it has been read
+
+    // If the limit was not read yet, read it from /proc
+    if (max_size == 0) {
+        FILE *limit = fopen("/proc/sys/fs/pipe-max-size", "r");
+        if (limit == NULL || fscanf(limit, "%ld", &max_size) != 1 || max_size <= 0) {
+            max_size = PIPES_DEFAULT_MAX_SIZE;
+        }
+        if (limit != NULL) {
+            fclose(limit);
+        }
+    }
+
+    return max_size;
+}
+
+// Turns the value of MINISHELL_PIPE_SIZE into a capacity in bytes
+long pipes_parse_size(const char *value) {
+    // If the setting is not set, keep the kernel default
+    if (value == NULL || *value == '\0') {
+        return 0;
+    }
+
+    // If the largest possible capacity is asked for, use the limit
+    if (strcmp(value, "max") == 0) {
+        return pipes_max_size();
+    }
+
+    char *end; // Declare a pointer to hold the position after the number
+    long multiplier = 1; // The unit given by the optional suffix
+    errno = 0;
+    long size = strtol(value, &end, 10);
+    int overflow = errno == ERANGE; // Whether the number does not fit in a long
+
+    // Read the optional suffix
+    if (*end == 'k' || *end == 'K') {
+        multiplier = 1024;
+        end++;
+    } else if (*end == 'm' || *end == 'M') {
+        multiplier = 1024 * 1024;
+        end++;
+    }
+
+    // If the value is not a positive number, keep the kernel default
+    if (*end != '\0' || size <= 0) {
+        return 0;
+    }
+
+    // A size too large to compute is larger than any pipe can be, so it asks for the largest capacity
+    if (overflow || size > LONG_MAX / multiplier) {
+        return pipes_max_size();
+    }
+    size *= multiplier;
+
+    return size < pipes_max_size() ? size : pipes_max_size();
+}
+
+// Creates a close-on-exec pipe set up with the given options
+long pipes_create(int fds[2], const pipe_options_t *options) {
+    int flags = O_CLOEXEC | (options && options->direct ? O_DIRECT : 0);
+
+    // Attempts to create the pipe. If packet mode is not supported, fall back to a plain pipe
+    if (pipe2(fds, flags) == -1 && (!(flags & O_DIRECT) || errno != EINVAL || pipe2(fds, O_CLOEXEC) == -1)) {
+        return -1;
+    }
+
+    // If a capacity was asked for, try to set it (the kernel rounds it up to a power of two pages)
+    if (options && options->size > 0) {
+        fcntl(fds[1], F_SETPIPE_SZ, (int)options->size);
+    }
+
+    long size = fcntl(fds[1], F_GETPIPE_SZ);
+    return size > 0 ? size : 0;
+}
+
+// Reads how many bytes a process has written so far
+int pipes_written_bytes(pid_t pid, unsigned long long *bytes) {
+    char path[64]; // Declare a buffer to hold the path of the counters
+    char line[128]; // Declare a buffer to hold each line of the counters
+    int found = 0; // Tracks whether the counter was found
+
+    snprintf(path, sizeof(path), "/proc/%d/io", (int)pid);
+    FILE *io = fopen(path, "r");
+
+    // If the counters cannot be read (for example when the kernel does not keep them), return an error
+    if (io == NULL) {
+        return 1;
+    }
+
+    // Pick the counter of bytes passed to write calls
+    while (!found && fgets(line, sizeof(line), io) != NULL) {
+        found = sscanf(line, "wchar: %llu", bytes) == 1;
+    }
+
+    fclose(io);
+    return !found;
+}
@@ -0,0 +1,68 @@
+// A header file that declares the pipes connecting the two commands of a pipeline
+//
+// By default a pipeline gets a plain pipe with the kernel's default capacity (usually 64 KiB). For stages that
+// move a lot of data, the pipe can be given a larger capacity so the commands switch less often, and it can
+// be put in packet mode (O_DIRECT). The settings are read from shell variables, so they apply to the whole
+// shell when set on their own, or to one pipeline when assigned in front of it:
+//
+//   MINISHELL_PIPE_SIZE    Capacity of the pipe in bytes (with an optional k or m suffix), or "max" for the
+//                          limit in /proc/sys/fs/pipe-max-size. Larger values are capped at that limit.
+//   MINISHELL_PIPE_DIRECT  Set to 1 to create the pipe in packet mode, where each write is a separate packet.
+//   MINISHELL_PIPE_REPORT  Set to 1 to report the bytes sent through the pipe (at most what the first stage
+//                          wrote) and the throughput of each stage.
+
+#ifndef _PIPES_H
+#define _PIPES_H
+
+#include <sys/types.h>
+
+/** How the pipe of a pipeline is set up. */
+typedef struct {
+    long size;                  /* Capacity to give the pipe in bytes, or 0 to keep the kernel default. */
+    int direct;                 /* Whether the pipe is created in packet mode (O_DIRECT). */
+    int report;                 /* Whether the throughput of each stage is reported. */
+} pipe_options_t;
+
+/**
+ * Reads the largest capacity an unprivileged process can give a pipe, from /proc/sys/fs/pipe-max-size. The
+ * limit is read once and remembered.
+ *
+ * @return The limit in bytes, or 1 MiB (the kernel's default limit) if it could not be read.
+ */
+long pipes_max_size();
+
+/**
+ * Turns the value of MINISHELL_PIPE_SIZE into a capacity in bytes, capped at the pipe-max-size limit.
+ *
+ * @param value The value of the setting, or NULL if it is not set.
+ *
+ * @return The capacity in bytes, or 0 (the kernel default) if the value is not set or not valid. A value too
+ *         large to compute counts as "max".
+ */
+long pipes_parse_size(const char *value);
+
+/**
+ * Creates a close-on-exec pipe set up with the given options. Options the kernel refuses (such as packet mode
+ * on old kernels, or a capacity above the limit) are left out rather than treated as errors.
+ *
+ * @param fds An array that will hold the read and write end of the pipe.
+ * @param options How to set up the pipe (can be NULL for a plain pipe).
+ *
+ * @return The capacity of the pipe in bytes, or -1 if the pipe could not be created.
+ */
+long pipes_create(int fds[2], const pipe_options_t *options);
+
+/**
+ * Reads how many bytes a process has written so far, from the wchar counter of /proc/<pid>/io. For the first
+ * stage of a pipeline, whose standard output is the pipe, this bounds the data sent through the pipe from above
+ * (it also counts writes to standard error and to other files). The counter can still be read after the
+ * process exited, as long as it has not been reaped yet.
+ *
+ * @param pid The process ID.
+ * @param bytes A pointer to where the number of bytes written will be stored.
+ *
+ * @return 0 for success, 1 if the counter could not be read.
+ */
+int pipes_written_bytes(pid_t pid, unsigned long long *bytes);
+
+#endif
@@ -0,0 +1,877 @@
+// A source file that defines compiled command plans, used by the source built-in command
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "vect.h"
+#include "tokens.h"
+#include "cache.h"
+#include "hash.h"
+#include "heredoc.h"
+#include "plan.h"
+#include "memstats.h"
+
+#define PLAN_HAS_INPUT 1 // Flag set on a compiled command that redirects its input from a file
+#define PLAN_HAS_OUTPUT 2 // Flag set on a compiled command that redirects its output to a file
+#define PLAN_HAS_HERE 4 // Flag set on a compiled command that reads a here-document or here-string
+#define PLAN_HAS_VARIABLES 8 // Flag set on a compiled command whose strings refer to variables
+
+/**
+ * Header at the start of a compiled plan file. It is followed by one record per command: the kind, the
+ * jump target, the number of arguments, the number of piped arguments and the flags (each a 32-bit integer),
+ * then every string of the command as a 32-bit length followed by the bytes and a null terminator.
+ */
+typedef struct {
+    char magic[4];              /* Always PLAN_MAGIC. */
+    uint32_t version;           /* Always PLAN_VERSION. */
+    uint64_t hash;              /* Hash of the contents of the script. */
+    int64_t mtime_sec;          /* Modification time of the script (seconds). */
+    int64_t mtime_nsec;         /* Modification time of the script (nanoseconds). */
+    int64_t size;               /* Size of the script in bytes. */
+    uint64_t inode;             /* Inode of the script. */
+    uint64_t device;            /* Device of the script. */
+    uint32_t command_count;     /* Number of command records that follow. */
+    uint32_t pointer_count;     /* Number of argument slots (including NULL terminators) the records need. */
+} plan_header_t;
+
+/** Main data structure for a plan. */
+struct plan {
+    char *data;                 /* The compiled plan, either memory-mapped or on the heap. */
+    size_t length;              /* Number of bytes of data. */
+    int mapped;                 /* Whether data is a memory mapping (1) or a heap allocation (0). */
+    plan_command_t *commands;   /* The commands of the plan, pointing into data. */
+    unsigned int count;         /* Number of commands. */
+    const char **pointers;      /* Storage for the argument arrays of every command. */
+};
+
+/** A growable buffer used while compiling a plan. */
+typedef struct {
+    char *data;                 /* The bytes written so far. */
+    size_t length;              /* Number of bytes written so far. */
+    size_t capacity;            /* Number of bytes the buffer can hold before it has to grow. */
+} buffer_t;
+
+/** Appends bytes to the buffer, growing it if needed. */
+static int buffer_append(buffer_t *buffer, const void *data, size_t length) {
+
+    // If the buffer is too small, double its size until the data fits
+    if (buffer->length + length > buffer->capacity) {
+        size_t capacity = buffer->capacity ? buffer->capacity : 4096;
+        while (buffer->length + length > capacity) {
+            capacity *= 2;
+        }
+
+        char *grown = (char *)memstats_realloc(MEMSTATS_PLAN, buffer->data, capacity);
+
+        // If memory could not be allocated, return an error
+        if (grown == NULL) {
+            return 1;
+        }
+
+        buffer->data = grown;
+        buffer->capacity = capacity;
+    }
+
+    memcpy(buffer->data + buffer->length, data, length); // Copy the data to the end of the buffer
+    buffer->length += length; // Update the length of the buffer
+    return 0;
+}
+
+/** Appends a 32-bit integer to the buffer. */
+static int buffer_append_u32(buffer_t *buffer, uint32_t value) {
+    return buffer_append(buffer, &value, sizeof(value));
+}
+
+/** Appends a string to the buffer as its length, its bytes and a null terminator. */
+static int buffer_append_string(buffer_t *buffer, const char *string, size_t length) {
+    return buffer_append_u32(buffer, (uint32_t)length) || buffer_append(buffer, string, length)
+           || buffer_append(buffer, "", 1);
+}
+
+/** The pieces of a command collected while compiling a line. */
+typedef struct {
+    vect_t *args;               /* The command and its arguments. */
+    vect_t *piped_args;         /* The command the output is piped into, or NULL. */
+    const char *input_file;     /* File redirected to standard input, or NULL. */
+    const char *output_file;    /* File standard output is redirected to, or NULL. */
+    char *here_data;            /* Contents of a here-document or here-string, or NULL. */
+    size_t here_length;         /* Number of bytes in here_data. */
+} pending_command_t;
+
+/** An open for, while or if block, remembered until the keyword that closes it. */
+typedef struct {
+    uint32_t kind;              /* Kind of the record that opened the block (PLAN_FOR, PLAN_WHILE, PLAN_IF or PLAN_ELSE). */
+    uint32_t index;             /* Index of that record in the plan. */
+    size_t offset;              /* Offset of that record in the buffer, used to fill in its jump target. */
+} open_block_t;
+
+/** The state of a compilation that carries over from one line to the next. */
+typedef struct {
+    buffer_t *buffer;           /* The plan being written. */
+    plan_header_t *header;      /* The header of the plan, whose counts are updated as records are written. */
+    open_block_t blocks[PLAN_MAX_NESTING]; /* The blocks that are still open, innermost last. */
+    unsigned int depth;         /* Number of blocks that are still open. */
+} compiler_t;
+
+/** Returns whether a string refers to a variable, so that it has to be expanded before it is used. */
+static int has_variable(const char *string) {
+    return string != NULL && strchr(string, '$') != NULL;
+}
+
+/**
+ * Writes one record to the buffer. The arguments are args[from] onwards, preceded by first if it is not
+ * NULL. Only plain commands and conditions carry the pipe and redirections of the pending command.
+ */
+static int write_record(compiler_t *compiler, uint32_t kind, uint32_t target, pending_command_t *command,
+                        const char *first, unsigned int from) {
+    buffer_t *buffer = compiler->buffer;
+    int full = kind == PLAN_COMMAND || kind == PLAN_IF || kind == PLAN_WHILE; // Whether the whole command is kept
+    unsigned int argc = vect_size(command->args) - from + (first ? 1 : 0);
+    unsigned int piped_argc = full && command->piped_args ? vect_size(command->piped_args) : 0;
+    uint32_t flags = 0;
+    int result = 0; // Tracks whether writing the record failed
+
+    // Work out which optional parts the record has, and whether any of its strings refer to variables
+    if (full) {
+        flags |= (command->input_file ? PLAN_HAS_INPUT : 0) | (command->output_file ? PLAN_HAS_OUTPUT : 0)
+                 | (command->here_data ? PLAN_HAS_HERE : 0);
+        if (has_variable(command->input_file) || has_variable(command->output_file)) {
+            flags |= PLAN_HAS_VARIABLES;
+        }
+        for (unsigned int i = 0; i < piped_argc; i++) {
+            flags |= has_variable(vect_get(command->piped_args, i)) ? PLAN_HAS_VARIABLES : 0;
+        }
+    }
+    for (unsigned int i = from; i < vect_size(command->args); i++) {
+        flags |= has_variable(vect_get(command->args, i)) ? PLAN_HAS_VARIABLES : 0;
+    }
+
+    result |= buffer_append_u32(buffer, kind);
+    result |= buffer_append_u32(buffer, target);
+    result |= buffer_append_u32(buffer, argc);
+    result |= buffer_append_u32(buffer, piped_argc);
+    result |= buffer_append_u32(buffer, flags);
+
+    // Write the arguments of both commands
+    if (first) {
+        result |= buffer_append_string(buffer, first, strlen(first));
+    }
+    for (unsigned int i = from; i < vect_size(command->args); i++) {
+        result |= buffer_append_string(buffer, vect_get(command->args, i), strlen(vect_get(command->args, i)));
+    }
+    for (unsigned int i = 0; i < piped_argc; i++) {
+        result |= buffer_append_string(buffer, vect_get(command->piped_args, i),
+                                       strlen(vect_get(command->piped_args, i)));
+    }
+
+    // Write the redirections
+    if (flags & PLAN_HAS_INPUT) {
+        result |= buffer_append_string(buffer, command->input_file, strlen(command->input_file));
+    }
+    if (flags & PLAN_HAS_OUTPUT) {
+        result |= buffer_append_string(buffer, command->output_file, strlen(command->output_file));
+    }
+    if (flags & PLAN_HAS_HERE) {
+        result |= buffer_append_string(buffer, command->here_data, command->here_length);
+    }
+
+    compiler->header->command_count++;
+    compiler->header->pointer_count += argc + 1 + (piped_argc ? piped_argc + 1 : 0);
+    return result;
+}
+
+/** Points the jump of an already written record at the given index. */
+static void patch_target(compiler_t *compiler, open_block_t *block, uint32_t target) {
+    memcpy(compiler->buffer->data + block->offset + sizeof(uint32_t), &target, sizeof(target));
+}
+
+/** Remembers a record that opens a block, failing if the blocks are nested too deeply. */
+static int open_block(compiler_t *compiler, uint32_t kind) {
+    if (compiler->depth == PLAN_MAX_NESTING) {
+        return 1;
+    }
+
+    open_block_t *block = &compiler->blocks[compiler->depth++];
+    block->kind = kind;
+    block->index = compiler->header->command_count;
+    block->offset = compiler->buffer->length;
+    return 0;
+}
+
+/**
+ * Writes a finished command to the buffer and resets it for the next command.
+ *
+ * A command may start with keywords of the control flow syntax: "for", "while" and "if" open a block,
+ * "do" and "then" start its body, "else" switches to the other branch of an if, and "done" and "fi" close
+ * the block. Each keyword is turned into a record with a jump target, so the plan can be run without
+ * parsing it again.
+ *
+ * @return 0 for success, 1 for a syntax error or a failed write.
+ */
+static int emit_command(compiler_t *compiler, pending_command_t *command) {
+    unsigned int start = 0; // Index of the first argument that has not been handled yet
+    unsigned int argc = vect_size(command->args); // The number of arguments of the command
+    int result = 0; // Tracks whether writing the command failed
+    open_block_t *top; // The innermost open block
+
+    // Handle the keywords at the start of the command, one at a time
+    while (result == 0 && start < argc) {
+        const char *word = vect_get(command->args, start);
+        top = compiler->depth ? &compiler->blocks[compiler->depth - 1] : NULL;
+
+        // "do" starts the body of a loop, and "then" the body of an if
+        if (strcmp(word, "do") == 0 || strcmp(word, "then") == 0) {
+            if (top == NULL || (word[0] == 'd' ? top->kind == PLAN_IF || top->kind == PLAN_ELSE
+                                               : top->kind != PLAN_IF)) {
+                result = 1;
+            }
+            start++;
+        }
+
+        // "for name in words" binds the name to each of the words in turn
+        else if (strcmp(word, "for") == 0) {
+            if (start + 2 >= argc || strcmp(vect_get(command->args, start + 2), "in") != 0) {
+                result = 1;
+                break;
+            }
+            result = open_block(compiler, PLAN_FOR)
+                     || write_record(compiler, PLAN_FOR, 0, command, vect_get(command->args, start + 1), start + 3);
+            break;
+        }
+
+        // "while command" and "if command" run the command as a condition
+        else if (strcmp(word, "while") == 0 || strcmp(word, "if") == 0) {
+            uint32_t kind = word[0] == 'w' ? PLAN_WHILE : PLAN_IF;
+            if (start + 1 >= argc) {
+                result = 1;
+                break;
+            }
+            result = open_block(compiler, kind) || write_record(compiler, kind, 0, command, NULL, start + 1);
+            break;
+        }
+
+        // "else" skips to the end of the if when the first branch was taken, and is where a failed condition jumps
+        else if (strcmp(word, "else") == 0) {
+            if (top == NULL || top->kind != PLAN_IF) {
+                result = 1;
+                break;
+            }
+            patch_target(compiler, top, compiler->header->command_count + 1);
+            top->kind = PLAN_ELSE;
+            top->index = compiler->header->command_count;
+            top->offset = compiler->buffer->length;
+            result = write_record(compiler, PLAN_ELSE, 0, command, NULL, argc);
+            start++;
+        }
+
+        // "done" jumps back to the head of the loop, and is where the loop exits past
+        else if (strcmp(word, "done") == 0) {
+            if (top == NULL || (top->kind != PLAN_FOR && top->kind != PLAN_WHILE)) {
+                result = 1;
+                break;
+            }
+            result = write_record(compiler, PLAN_DONE, top->index, command, NULL, argc);
+            patch_target(compiler, top, compiler->header->command_count);
+            compiler->depth--;
+            start++;
+        }
+
+        // "fi" is where a failed condition (or a finished first branch) continues
+        else if (strcmp(word, "fi") == 0) {
+            if (top == NULL || (top->kind != PLAN_IF && top->kind != PLAN_ELSE)) {
+                result = 1;
+                break;
+            }
+            patch_target(compiler, top, compiler->header->command_count);
+            compiler->depth--;
+            start++;
+        }
+
+        // Anything else is a plain command
+        else {
+            result = write_record(compiler, PLAN_COMMAND, 0, command, NULL, start);
+            break;
+        }
+    }
+
+    // Reset the command for the next one
+    vect_delete(command->args);
+    if (command->piped_args) {
+        vect_delete(command->piped_args);
+    }
+    memstats_free(command->here_data);
+    memset(command, 0, sizeof(*command));
+    command->args = vect_new();
+
+    return result;
+}
+
+/**
+ * Compiles the tokens of one line into command records. Here-documents read their body from the lines
+ * that follow in the script.
+ */
+static int compile_line(FILE *in, vect_t *tokens, compiler_t *compiler) {
+    pending_command_t command = { vect_new(), NULL, NULL, NULL, NULL, 0 }; // The command being collected
+    unsigned int count = vect_size(tokens); // The number of tokens on the line
+    int result = 0; // Tracks whether writing a command failed
+
+    // Walk through the tokens, collecting commands and their redirections
+    for (unsigned int i = 0; i < count; i++) {
+        const char *token = vect_get(tokens, i);
+
+        // A semicolon ends the current command
+        if (strcmp(token, ";") == 0) {
+            result |= emit_command(compiler, &command);
+        }
+
+        // A pipe starts the command the output is piped into
+        else if (strcmp(token, "|") == 0) {
+            if (command.piped_args == NULL) {
+                command.piped_args = vect_new();
+            }
+        }
+
+        // Three '<' in a row start a here-string, which feeds the following word and a newline
+        else if (strcmp(token, "<") == 0 && i + 3 < count && strcmp(vect_get(tokens, i + 1), "<") == 0
+                 && strcmp(vect_get(tokens, i + 2), "<") == 0) {
+            const char *word = vect_get(tokens, i + 3);
+            word += word[0] == TOKENS_QUOTED; // The here-string is not expanded, so it keeps no mark
+            memstats_free(command.here_data);
+            command.here_length = strlen(word) + 1;
+            command.here_data = (char *)memstats_malloc(MEMSTATS_PLAN, command.here_length);
+            if (command.here_data != NULL) {
+                memcpy(command.here_data, word, command.here_length - 1);
+                command.here_data[command.here_length - 1] = '\n';
+            }
+            i += 3;
+        }
+
+        // Two '<' in a row start a here-document, whose body follows on the next lines of the script
+        else if (strcmp(token, "<") == 0 && i + 2 < count && strcmp(vect_get(tokens, i + 1), "<") == 0) {
+            memstats_free(command.here_data);
+            command.here_data = read_here_document(in, vect_get(tokens, i + 2), &command.here_length);
+            i += 2;
+        }
+
+        // A single '<' redirects the input from the following file
+        else if (strcmp(token, "<") == 0 && i + 1 < count) {
+            command.input_file = vect_get(tokens, ++i);
+        }
+
+        // A '>' redirects the output to the following file
+        else if (strcmp(token, ">") == 0 && i + 1 < count) {
+            command.output_file = vect_get(tokens, ++i);
+        }
+
+        // Anything else is an argument of the current command
+        else {
+            vect_add(command.piped_args ? command.piped_args : command.args, token);
+        }
+    }
+
+    result |= emit_command(compiler, &command); // Write the last command of the line
+    vect_delete(command.args); // Free the empty command left behind
+    return result;
+}
+
+/**
+ * Compiles a whole script, line by line, into a plan stored in the buffer.
+ *
+ * @return 0 for success, 1 for a syntax error, or 2 if the script ends inside a block.
+ */
+static int compile_script(FILE *in, buffer_t *buffer, plan_header_t *header) {
+    char *line = NULL; // Declare a buffer to read each line of the script, grown by getline to fit any line
+    size_t line_capacity = 0; // Declare a variable to hold the size of that buffer
+    compiler_t compiler = { buffer, header, {{ 0, 0, 0 }}, 0 }; // Start with no open blocks
+    int result = buffer_append(buffer, header, sizeof(*header)); // Reserve room for the header
+
+    // Iterates over the lines of the script until the end is reached
+    while (result == 0 && getline(&line, &line_capacity, in) != -1) {
+        line[strcspn(line, "\n")] = '\0'; // Remove the newline character from the end of the line
+
+        vect_t *tokens; // Declare a vector to hold the tokens of the line
+        result = tokenize(line, &tokens); // Tokenize the line, failing on an unmatched double quote
+        if (result == 0) {
+            result = compile_line(in, tokens, &compiler); // Compile the line into command records
+        }
+        vect_delete(tokens); // Free all the memory used by the tokens
+    }
+    free(line); // Free the line buffer, which getline allocated
+
+    // If a block was never closed, more lines are needed
+    if (result == 0 && compiler.depth > 0) {
+        result = 2;
+    }
+
+    // Write the finished header, now that the counts are known
+    if (result == 0) {
+        memcpy(buffer->data, header, sizeof(*header));
+    }
+
+    return result;
+}
+
+/** Reads a 32-bit integer from a compiled plan, checking that it lies within the plan. */
+static int read_u32(const char **cursor, const char *end, uint32_t *value) {
+    if ((size_t)(end - *cursor) < sizeof(*value)) {
+        return 1;
+    }
+
+    memcpy(value, *cursor, sizeof(*value));
+    *cursor += sizeof(*value);
+    return 0;
+}
+
+/** Reads a string from a compiled plan, checking that it lies within the plan and is null-terminated. */
+static int read_string(const char **cursor, const char *end, const char **string, size_t *length) {
+    uint32_t value; // Declare a variable to hold the length of the string
+
+    if (read_u32(cursor, end, &value) != 0 || (size_t)(end - *cursor) <= value || (*cursor)[value] != '\0') {
+        return 1;
+    }
+
+    *string = *cursor;
+    *length = value;
+    *cursor += value + 1;
+    return 0;
+}
+
+/** Reads a number of strings from a compiled plan into a NULL-terminated argument array. */
+static int read_args(const char **cursor, const char *end, const char **args, uint32_t count) {
+    size_t length; // Declare a variable to hold the length of each argument
+
+    for (uint32_t i = 0; i < count; i++) {
+        if (read_string(cursor, end, &args[i], &length) != 0) {
+            return 1;
+        }
+    }
+
+    args[count] = NULL; // Null terminate the argument array
+    return 0;
+}
+
+/** Finds where a block ends: at the done of a loop, or where the jump of an if or else lands. */
+static unsigned int block_end(const plan_command_t *command) {
+    return command->kind == PLAN_FOR || command->kind == PLAN_WHILE ? command->target - 1 : command->target;
+}
+
+/**
+ * Checks that the jumps of a loaded plan form properly nested blocks, the way the compiler writes them: a for
+ * or while points just past the done that closes it (which points back at it), an if points past its body or
+ * just past its else, and no block is nested deeper than PLAN_MAX_NESTING. A plan file that was cut short or
+ * tampered with could otherwise make the run jump anywhere or run more loops than it has room for.
+ *
+ * @return 0 if the blocks are valid, 1 otherwise.
+ */
+static int check_blocks(plan_t *plan) {
+    unsigned int open[PLAN_MAX_NESTING]; // The blocks that are still open, innermost last
+    unsigned int depth = 0; // Number of blocks that are still open
+
+    for (unsigned int i = 0; i <= plan->count; i++) {
+        // Close the if blocks (and else branches) that end here
+        while (depth > 0 && (plan->commands[open[depth - 1]].kind == PLAN_IF
+                             || plan->commands[open[depth - 1]].kind == PLAN_ELSE)
+               && plan->commands[open[depth - 1]].target == i) {
+            depth--;
+        }
+
+        // Past the last command, every block has to be closed
+        if (i == plan->count) {
+            break;
+        }
+
+        const plan_command_t *command = &plan->commands[i];
+        const plan_command_t *top = depth ? &plan->commands[open[depth - 1]] : NULL; // The innermost open block
+        const plan_command_t *outer = depth > 1 ? &plan->commands[open[depth - 2]] : NULL; // The block around it
+
+        switch (command->kind) {
+            case PLAN_FOR:
+            case PLAN_WHILE:
+            case PLAN_IF:
+                // A for loop needs a variable, and every block has to end after it starts
+                if ((command->kind == PLAN_FOR && command->args[0] == NULL)
+                    || command->target <= i + (command->kind == PLAN_IF ? 0 : 1)) {
+                    return 1;
+                }
+
+                // The block has to end inside the block around it, and there has to be room for it
+                if (depth == PLAN_MAX_NESTING || (top != NULL && block_end(command) > block_end(top))) {
+                    return 1;
+                }
+                open[depth++] = i;
+                break;
+
+            // An else takes the place of the if it belongs to, whose condition jumps just past the else
+            case PLAN_ELSE:
+                if (top == NULL || top->kind != PLAN_IF || top->target != i + 1 || command->target <= i
+                    || (outer != NULL && block_end(command) > block_end(outer))) {
+                    return 1;
+                }
+                open[depth - 1] = i;
+                break;
+
+            // A done closes the innermost loop, which has to be the one it jumps back to
+            case PLAN_DONE:
+                if (top == NULL || (top->kind != PLAN_FOR && top->kind != PLAN_WHILE) || command->target != open[depth - 1]
+                    || top->target != i + 1) {
+                    return 1;
+                }
+                depth--;
+                break;
+        }
+    }
+
+    return depth != 0;
+}
+
+/**
+ * Builds the commands of a plan from its compiled data. The argument arrays point straight into the data,
+ * so nothing is tokenized or copied.
+ *
+ * @return 0 for success, 1 if the data is not a valid plan.
+ */
+static int plan_load(plan_t *plan) {
+    plan_header_t header; // Declare a structure to hold the header of the plan
+
+    // If the data is too short or not a plan of this version, it cannot be loaded
+    if (plan->length < sizeof(header)) {
+        return 1;
+    }
+    memcpy(&header, plan->data, sizeof(header));
+    if (memcmp(header.magic, PLAN_MAGIC, sizeof(header.magic)) != 0 || header.version != PLAN_VERSION) {
+        return 1;
+    }
+
+    // Drop anything left over from an earlier attempt to load the plan
+    memstats_free(plan->commands);
+    memstats_free(plan->pointers);
+
+    // Allocate the commands and all of their argument arrays at once
+    plan->commands = (plan_command_t *)memstats_calloc(MEMSTATS_PLAN, (size_t)header.command_count + 1, sizeof(plan_command_t));
+    plan->pointers = (const char **)memstats_calloc(MEMSTATS_PLAN, (size_t)header.pointer_count + 1, sizeof(char *));
+
+    // If memory could not be allocated, return an error
+    if (plan->commands == NULL || plan->pointers == NULL) {
+        return 1;
+    }
+
+    const char *cursor = plan->data + sizeof(header); // Start reading right after the header
+    const char *end = plan->data + plan->length; // Stop reading at the end of the data
+    const char **slot = plan->pointers; // The next free argument slot
+    const char **last_slot = plan->pointers + header.pointer_count; // One past the last argument slot
+
+    // Read each command record
+    for (plan->count = 0; plan->count < header.command_count; plan->count++) {
+        plan_command_t *command = &plan->commands[plan->count];
+        uint32_t kind, target, argc, piped_argc, flags; // Declare variables to hold the fixed fields of the record
+
+        if (read_u32(&cursor, end, &kind) != 0 || read_u32(&cursor, end, &target) != 0
+            || kind > PLAN_DONE || target > header.command_count || read_u32(&cursor, end, &argc) != 0 || read_u32(&cursor, end, &piped_argc) != 0
+            || read_u32(&cursor, end, &flags) != 0
+            || (size_t)(last_slot - slot) < (size_t)argc + 1 + (piped_argc ? (size_t)piped_argc + 1 : 0)) {
+            return 1;
+        }
+
+        command->kind = kind;
+        command->target = target;
+        command->has_variables = (flags & PLAN_HAS_VARIABLES) != 0;
+
+        // Read the arguments of the command
+        command->args = slot;
+        if (read_args(&cursor, end, slot, argc) != 0) {
+            return 1;
+        }
+        slot += (size_t)argc + 1;
+
+        // Read the arguments of the command the output is piped into
+        if (piped_argc > 0) {
+            command->piped_args = slot;
+            if (read_args(&cursor, end, slot, piped_argc) != 0) {
+                return 1;
+            }
+            slot += (size_t)piped_argc + 1;
+        }
+
+        size_t length; // Declare a variable to hold the length of each redirection
+
+        // Read the redirections
+        if ((flags & PLAN_HAS_INPUT) && read_string(&cursor, end, &command->input_file, &length) != 0) {
+            return 1;
+        }
+        if ((flags & PLAN_HAS_OUTPUT) && read_string(&cursor, end, &command->output_file, &length) != 0) {
+            return 1;
+        }
+        if ((flags & PLAN_HAS_HERE) && read_string(&cursor, end, &command->here_data, &command->here_length) != 0) {
+            return 1;
+        }
+    }
+
+    return check_blocks(plan); // Make sure the jumps cannot lead the run astray
+}
+
+/** Releases the commands and data of a plan, leaving it empty. */
+static void plan_release(plan_t *plan) {
+    memstats_free(plan->commands);
+    memstats_free(plan->pointers);
+
+    if (plan->mapped) {
+        munmap(plan->data, plan->length);
+    } else {
+        memstats_free(plan->data);
+    }
+
+    memset(plan, 0, sizeof(*plan));
+}
+
+/** Reads the whole contents of a file into a heap-allocated buffer. */
+static char *read_file(const char *filename, size_t *length) {
+    FILE *file = fopen(filename, "r"); // Open the file for reading
+
+    // If the file could not be opened, return NULL
+    if (file == NULL) {
+        return NULL;
+    }
+
+    buffer_t buffer = { NULL, 0, 0 }; // Declare a buffer to hold the contents
+    char chunk[65536]; // Declare a buffer to hold each chunk of the file
+    size_t chunk_length; // Declare a variable to hold the length of each chunk
+
+    int result = 0; // Tracks whether memory could be allocated
+
+    // Append chunks until the end of the file is reached
+    while (result == 0 && (chunk_length = fread(chunk, 1, sizeof(chunk), file)) > 0) {
+        result = buffer_append(&buffer, chunk, chunk_length);
+    }
+
+    fclose(file);
+
+    // An empty file still gets a buffer, so that NULL always means failure
+    if (result == 0 && buffer.data == NULL) {
+        buffer.data = (char *)memstats_malloc(MEMSTATS_PLAN, 1);
+        result = buffer.data == NULL;
+    }
+
+    // If memory could not be allocated, return NULL
+    if (result != 0) {
+        memstats_free(buffer.data);
+        return NULL;
+    }
+
+    *length = buffer.length;
+    return buffer.data;
+}
+
+/** Writes a compiled plan to the store, publishing it atomically under the given path. */
+static void plan_write(const char *path, const char *data, size_t length) {
+    char temporary[PATH_MAX + 64]; // Declare a buffer to hold the path the plan is written to first
+    const char *slash = strrchr(path, '/');
+
+    // Write the plan under a hidden name first so that a half-written plan is never loaded
+    snprintf(temporary, sizeof(temporary), "%.*s/.%s.%d", (int)(slash - path), path, slash + 1, (int)getpid());
+
+    int fd = open(temporary, O_WRONLY | O_CREAT | O_TRUNC, 0644); // Create the new plan file
+
+    // If the plan file could not be created, the script will simply be compiled again next time
+    if (fd == -1) {
+        return;
+    }
+
+    // Publish the finished plan under its real name, or throw it away if it could not be written
+    if (write(fd, data, length) != (ssize_t)length || close(fd) != 0 || rename(temporary, path) != 0) {
+        unlink(temporary);
+    }
+}
+
+/**
+ * Compiles text held in memory into the given empty plan.
+ *
+ * @return 0 for success, 1 for a syntax error, or 2 if the text ends inside a block.
+ */
+static int compile_text(plan_t *plan, const char *text, size_t length, plan_header_t *header) {
+    buffer_t buffer = { NULL, 0, 0 }; // Declare a buffer to hold the compiled plan
+    FILE *in = length ? fmemopen((void *)text, length, "r") : NULL; // Read the text from memory
+    int result;
+
+    // Compile the text, treating empty text as a plan with no commands
+    if (in != NULL) {
+        result = compile_script(in, &buffer, header);
+        fclose(in);
+    } else {
+        result = length ? 1 : buffer_append(&buffer, header, sizeof(*header));
+    }
+
+    plan->data = buffer.data;
+    plan->length = buffer.length;
+    return result != 0 ? result : plan_load(plan);
+}
+
+// Opens the compiled plan of a script, compiling it if there is no up-to-date plan in the store
+plan_t *plan_open(const char *filename) {
+    struct stat info; // Declare a structure to hold the script's metadata
+    char resolved[PATH_MAX]; // Declare a buffer to hold the absolute path of the script
+    char path[PATH_MAX + 32]; // Declare a buffer to hold the path of the compiled plan
+    char plans[PATH_MAX]; // Declare a buffer to hold the directory of compiled plans
+    const char *dir = cache_dir(); // Find the store that holds compiled plans
+
+    // Plans live in a directory of their own, so they are not counted or evicted along with cached results
+    if (dir != NULL) {
+        snprintf(plans, sizeof(plans), "%s/" PLAN_DIR, dir);
+        dir = mkdir(plans, 0755) == 0 || errno == EEXIST ? plans : NULL;
+    }
+
+    // If the script does not exist, there is no plan
+    if (stat(filename, &info) == -1 || realpath(filename, resolved) == NULL) {
+        return NULL;
+    }
+
+    plan_t *plan = (plan_t *)memstats_calloc(MEMSTATS_PLAN, 1, sizeof(plan_t)); // Allocate memory for the plan
+
+    // If memory could not be allocated, return NULL
+    if (plan == NULL) {
+        return NULL;
+    }
+
+    // Describe the script as it is right now
+    plan_header_t header; // Declare a structure to hold the header of the new plan
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, PLAN_MAGIC, sizeof(header.magic));
+    header.version = PLAN_VERSION;
+    header.mtime_sec = info.st_mtim.tv_sec;
+    header.mtime_nsec = info.st_mtim.tv_nsec;
+    header.size = info.st_size;
+    header.inode = info.st_ino;
+    header.device = info.st_dev;
+
+    // The plan of a script is stored under a name derived from its absolute path
+    if (dir != NULL) {
+        snprintf(path, sizeof(path), "%s/script-%016llx", dir, hash_bytes(HASH_INIT, resolved, strlen(resolved)));
+    }
+
+    int fd = dir ? open(path, O_RDWR) : -1; // Attempt to open a previously compiled plan
+    plan_header_t cached; // Declare a structure to hold the header of the previously compiled plan
+    struct stat cached_info; // Declare a structure to hold the metadata of the previously compiled plan
+
+    // If there is a previously compiled plan, map it into memory
+    if (fd != -1 && fstat(fd, &cached_info) == 0 && (size_t)cached_info.st_size >= sizeof(cached)) {
+        void *data = mmap(NULL, cached_info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (data != MAP_FAILED) {
+            plan->data = (char *)data;
+            plan->length = cached_info.st_size;
+            plan->mapped = 1;
+            memcpy(&cached, plan->data, sizeof(cached));
+        }
+    }
+
+    // If the script has not changed since it was compiled, use the compiled plan as is
+    if (plan->mapped && cached.mtime_sec == header.mtime_sec && cached.mtime_nsec == header.mtime_nsec
+        && cached.size == header.size && cached.inode == header.inode && cached.device == header.device
+        && plan_load(plan) == 0) {
+        close(fd);
+        return plan;
+    }
+
+    size_t length; // Declare a variable to hold the length of the script
+    char *contents = read_file(filename, &length); // Read the whole script
+
+    // If the script could not be read, there is no plan (errno says why)
+    if (contents == NULL) {
+        int error = errno; // Keep the reason, which closing could overwrite
+        if (fd != -1) {
+            close(fd);
+        }
+        plan_close(plan);
+        errno = error;
+        return NULL;
+    }
+
+    header.hash = hash_bytes(HASH_INIT, contents, length); // Hash the contents of the script
+
+    // If only the metadata of the script changed, re-stamp the compiled plan and use it
+    if (plan->mapped && cached.hash == header.hash) {
+        cached.mtime_sec = header.mtime_sec;
+        cached.mtime_nsec = header.mtime_nsec;
+        cached.size = header.size;
+        cached.inode = header.inode;
+        cached.device = header.device;
+
+        if (plan_load(plan) == 0) {
+            pwrite(fd, &cached, sizeof(cached), 0);
+            close(fd);
+            memstats_free(contents);
+            return plan;
+        }
+    }
+
+    // Otherwise, the script has to be compiled again
+    plan_release(plan);
+    if (fd != -1) {
+        close(fd);
+    }
+
+    int result = compile_text(plan, contents, length, &header); // Compile the script
+    memstats_free(contents);
+
+    // If the script could not be compiled, there is no plan. This is a syntax error, not a problem reading it
+    if (result != 0) {
+        plan_close(plan);
+        errno = EINVAL;
+        return NULL;
+    }
+
+    // Store the compiled plan so later runs can skip tokenizing the script
+    if (dir != NULL) {
+        plan_write(path, plan->data, plan->length);
+    }
+
+    return plan;
+}
+
+// Compiles a command line (or several lines) into a plan that is kept in memory only
+plan_t *plan_compile(const char *text) {
+    plan_header_t header; // Declare a structure to hold the header of the plan
+    plan_t *plan = (plan_t *)memstats_calloc(MEMSTATS_PLAN, 1, sizeof(plan_t)); // Allocate memory for the plan
+
+    // If memory could not be allocated, return NULL
+    if (plan == NULL) {
+        return NULL;
+    }
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, PLAN_MAGIC, sizeof(header.magic));
+    header.version = PLAN_VERSION;
+
+    // If the text could not be compiled, there is no plan
+    int result = compile_text(plan, text, strlen(text), &header);
+    if (result != 0) {
+        plan_close(plan);
+        errno = result == 2 ? EAGAIN : EINVAL;
+        return NULL;
+    }
+
+    return plan;
+}
+
+// Closes the plan, freeing all memory and mappings it occupies
+void plan_close(plan_t *plan) {
+    plan_release(plan);
+    memstats_free(plan);
+}
+
+// Returns the number of commands in the plan
+unsigned int plan_size(plan_t *plan) {
+    return plan->count;
+}
+
+// Returns the command at the given index
+const plan_command_t *plan_get(plan_t *plan, unsigned int idx) {
+    return &plan->commands[idx];
+}
@@ -0,0 +1,74 @@
+// A header file that declares compiled command plans, used by the source built-in command
+
+#ifndef _PLAN_H
+#define _PLAN_H
+
+#include <stddef.h>
+
+#define PLAN_MAGIC "MSHP" // Marks the start of a compiled plan file
+#define PLAN_VERSION 3 // Version of the compiled plan format, bumped whenever the layout changes
+#define PLAN_MAX_NESTING 64 // Maximum depth of nested for, while and if blocks
+#define PLAN_DIR "plans" // Directory of the cache store that holds compiled plans, apart from cached results
+
+// Kinds of plan commands. Plans are run from the first command to the last, except where a command jumps.
+#define PLAN_COMMAND 0 // Runs a command
+#define PLAN_IF 1 // Runs a command as a condition, jumping to target if it fails
+#define PLAN_WHILE 2 // Runs a command as the condition of a loop, jumping to target (past the loop) if it fails
+#define PLAN_ELSE 3 // Jumps to target (past the end of the if), reached when the first branch of an if is done
+#define PLAN_FOR 4 // Binds the variable args[0] to the next of args[1..], or jumps to target (past the loop)
+#define PLAN_DONE 5 // Jumps back to target (the head of the loop)
+
+/** A single command of a plan, ready to be executed. */
+typedef struct {
+    int kind;                   /* What the command does (one of the PLAN_ kinds above). */
+    unsigned int target;        /* Index of the command to jump to, for the kinds that jump. */
+    int has_variables;          /* Whether any string of the command refers to a variable ($name or ${name}). */
+    const char **args;          /* NULL-terminated command and arguments. */
+    const char **piped_args;    /* NULL-terminated command the output is piped into, or NULL for no pipe. */
+    const char *input_file;     /* File redirected to standard input, or NULL. */
+    const char *output_file;    /* File standard output is redirected to, or NULL. */
+    const char *here_data;      /* Contents of a here-document or here-string, or NULL. */
+    size_t here_length;         /* Number of bytes in here_data. */
+} plan_command_t;
+
+/** Type of a plan (fields are hidden). */
+typedef struct plan plan_t;
+
+/**
+ * Opens the compiled plan of a script.
+ *
+ * The plan is kept in the PLAN_DIR directory of the cache store, under a name derived from the script's path.
+ * If the cached plan still matches the script's modification time, size and inode, it is memory-mapped and
+ * used as is. If only the metadata changed but the contents hash the same, the cached plan is re-stamped and
+ * reused.
+ * Otherwise the script is tokenized once, compiled into a new plan and written back to the store.
+ *
+ * @param filename The path of the script.
+ *
+ * @return The plan, or NULL if the script could not be opened. errno is set to EINVAL if the script has a
+ *         syntax error (an unmatched double quote, a stray done or fi, or a block that is never closed), and to
+ *         the error that occurred while reading the script otherwise.
+ */
+plan_t *plan_open(const char *filename);
+
+/**
+ * Compiles a command line (or several lines) into a plan that is kept in memory only. Here-documents read
+ * their body from the lines that follow them in the text.
+ *
+ * @param text The null-terminated text to compile.
+ *
+ * @return The plan, or NULL if the text could not be compiled. errno is set to EAGAIN if the text ends inside
+ *         a for, while or if block (so more lines are needed), and to EINVAL for any other error.
+ */
+plan_t *plan_compile(const char *text);
+
+/** Close the plan, freeing all memory and mappings it occupies. */
+void plan_close(plan_t *plan);
+
+/** The number of commands in the plan. */
+unsigned int plan_size(plan_t *plan);
+
+/** Get the command at the given index. */
+const plan_command_t *plan_get(plan_t *plan, unsigned int idx);
+
+#endif
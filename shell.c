@@ -7,178 +7,195 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <limits.h>
 
 #include "tokens.h"
 #include "vect.h"
+#include "cache.h"
+#include "heredoc.h"
+#include "plan.h"
+#include "minishell.h"
+#include "vars.h"
+#include "memstats.h"
 
 // Declaring the built-in commands to be defined later in this file
 void help();
 int cd(const char *path);
 void prev(const char* prev_command);
 void source(const char* filename);
+int cache_command(const char **args, const char *input_file, const char *output_file, int input_fd);
 
 /**
- * Executes command with its arguments.
+ * Isolates a single word starting at the given position, skipping leading whitespace. The word ends at
+ * whitespace or at one of the operators <, >, | and ;, so "<<EOF>out" has the delimiter EOF. A word wrapped in
+ * double quotes may contain spaces. The word is null-terminated in place.
  *
- * @param args A character array that holds the command and its arguments.
+ * @param start A pointer to the position in a command string where the word begins.
+ *
+ * @return A pointer to the start of the word, or NULL if no word was found.
  */
-void execute(const char **args, const char *input_file, const char *output_file) {
-    pid_t pid; // Declare a variable to store the process ID of the child process
-    int status; // Declare a variable to store the exit status of the child process
-
-    pid = fork(); // Create a new process by forking the current process
-
-    // If this is the child process,
-    if (pid == 0) {
-
-        // If there is an input file to handle,
-        if (input_file) {
+char *parse_word(char *start) {
+    // Skip over any whitespace in front of the word
+    while (*start == ' ' || *start == '\t') {
+        start++;
+    }
 
-            // Attempt to open the input file and save it as a file descriptor
-            int input_fd = open(input_file, O_RDONLY);
+    // If the word is wrapped in double quotes, it ends at the closing quote
+    if (*start == '"') {
+        start++; // Move past the opening quote
+        char *end = strchr(start, '"'); // Find the closing quote
 
-            // If the file could not be opened,
-            if (input_fd == -1) {
-                perror("ERROR: could not open the input file"); // Print an error message
-                exit(1); // Exit with an error code to indicate failure
-            }
-
-            dup2(input_fd, STDIN_FILENO); // Duplicate the file descriptor
-            close(input_fd); // Close the file descriptor
+        // If there is a closing quote, null-terminate the word there
+        if (end != NULL) {
+            *end = '\0';
         }
+        return start;
+    }
 
-        // If there is an output file to handle,
-        if (output_file) {
+    // If there is no word at all, return NULL
+    if (*start == '\0') {
+        return NULL;
+    }
 
-            // Attempt to open the output file and save it as a file descriptor
-            int output_fd = open(output_file, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    char *end = start + strcspn(start, " \t<>|;"); // Find the first whitespace character or operator after the word
+    *end = '\0'; // Null terminate the word
+    return start;
+}
 
-            // If the file could not be opened,
-            if (output_fd == -1) {
-                perror("ERROR: could not open the output file"); // Print an error message
-                exit(1); // Exit with an error code to indicate failure
-            }
+/**
+ * Prints why a command could not be run.
+ *
+ * @param status The status returned by the library for the command.
+ */
+void report_error(const minishell_status_t *status) {
+    fprintf(stderr, "ERROR: %s: %s\n", status->stage, strerror(status->error));
+}
 
-            dup2(output_fd, STDOUT_FILENO); // Duplicate the file descriptor
-            close(output_fd); // Close the file descriptor
-        }
+/**
+ * Prints the throughput of a stage of a pipeline.
+ *
+ * @param report The throughput reported by the library for the stage.
+ */
+void report_throughput(const minishell_throughput_t *report) {
+    fprintf(stderr, "%s (stage %d): up to %llu bytes through the pipe in %.3f s, %.1f MB/s (pipe of %ld bytes%s)\n",
+            report->command, report->stage, report->bytes, report->seconds, report->bytes_per_second / 1e6,
+            report->pipe_size, report->direct ? ", packet mode" : "");
+}
 
-        // Replace the current process with a new program specified by args[0]
-        if (execvp(args[0], (char *const *)args) == -1) {
-            perror("ERROR: execvp failed in execute"); // Print an error message
-            exit(1); // Exit the child process with an error code to indicate failure
-        }
-    }
+/**
+ * Executes command with its arguments.
+ *
+ * @param args A character array that holds the command and its arguments.
+ * @param input_file A string specifying an input file for redirection (can be NULL for no redirection).
+ * @param output_file A string specifying an output file for redirection (can be NULL for no redirection).
+ * @param input_fd A file descriptor to use as standard input, such as a here-document (-1 for none).
+ *
+ * @return The exit status of the command, or 1 if it could not be run.
+ */
+int execute(const char **args, const char *input_file, const char *output_file, int input_fd) {
+    minishell_status_t status; // Declare a structure to hold the outcome of the command
 
-    // If the child process was not created,
-    else if (pid < 0) {
-        perror("ERROR: fork failed in execute"); // Print an error message
-        exit(1); // Exit the parent process with an error code to indicate failure
+    // Run the command. If it could not be run,
+    if (minishell_execute(args, input_file, output_file, input_fd, NULL, &status) != 0) {
+        report_error(&status); // Print an error message
+        return 1; // Return an exit code of 1 to indicate failure
     }
 
-    // Otherwise, we are in the parent process, so,
-    else {
-        waitpid(pid, &status, 0); // Wait for the child process to complete and store its status
-    }
+    // Return the exit status of the command, treating a command killed by a signal as a failure
+    return status.exit_status == -1 ? 1 : status.exit_status;
 }
 
 /**
- * Executes two shell commands in a piped fashion with optional input and output redirection.
+ * Runs a command typed at the prompt, optionally piped into a second command. The library expands its
+ * variables, applies its variable assignments and runs it as a built-in command if there is one with its name.
  *
- * @param command_one_args An array of strings representing the first command and its arguments.
- * @param command_two_args An array of strings representing the second command and its arguments.
- * @parm input_file A string specifying an input file for redirection (can be NULL for no redirection).
+ * @param args A NULL-terminated array holding the command and its arguments.
+ * @param piped_args A NULL-terminated array holding the command the output is piped into (can be NULL for no pipe).
+ * @param input_file A string specifying an input file for redirection (can be NULL for no redirection).
  * @param output_file A string specifying an output file for redirection (can be NULL for no redirection).
+ * @param here_data The contents of a here-document or here-string to use as standard input (can be NULL for none).
+ * @param here_length The number of bytes of here_data.
  */
-void execute_piped(const char **command_one_args, const char **command_two_args, const char *input_file, const char *output_file) {
-
-    int pipefd[2]; // Declare an array to hold the read and write end of the pipe
-    pid_t command_one_pid, command_two_pid; // Declare two variables that will store the PIDs of the child processes
-    int status; // Declare a variable to store the exit status of the child processes when they terminate
-
-    // Attempts to create a pipe. If the pipe cannot be created,
-    if (pipe(pipefd) == -1) {
-        perror("ERROR: pipe failed to be created"); // Print an error message
-        exit(1); // Exit with an error code to indicate failure
+void run_parsed(const char **args, const char **piped_args, const char *input_file, const char *output_file,
+                const char *here_data, size_t here_length) {
+    plan_command_t command = { PLAN_COMMAND, 0, 0, args, piped_args, input_file, output_file, here_data, here_length };
+    minishell_status_t status; // Declare a structure to hold the outcome of the command
+
+    // Work out whether any string of the command refers to a variable, so that it gets expanded
+    for (unsigned int i = 0; args[i] != NULL; i++) {
+        command.has_variables |= strchr(args[i], '$') != NULL;
     }
-
-    command_one_pid = fork(); // Creates a child process for the first command
-
-    // If this is the child process,
-    if (command_one_pid == 0) {
-        close(pipefd[0]); // Close the read end of the pipe
-        dup2(pipefd[1], STDOUT_FILENO); // Redirect stdout to the write end of the pipe
-        close(pipefd[1]); // Close the right end of the pipe
-
-        // Attempts to execute the first command. If the command cannot be executed,
-        if (execvp(command_one_args[0], (char *const *)command_one_args) == -1) {
-            perror("ERROR: execvp failed to run the first command"); // Print an error message
-            exit(1); // Exit with an error code to indicate failure
-        }
+    for (unsigned int i = 0; piped_args != NULL && piped_args[i] != NULL; i++) {
+        command.has_variables |= strchr(piped_args[i], '$') != NULL;
     }
+    command.has_variables |= (input_file && strchr(input_file, '$')) || (output_file && strchr(output_file, '$'));
 
-    // If fork fails for the first command,
-    else if (command_one_pid < 0) {
-        perror("ERROR: fork failed the execute the first command"); // Print an error message
-        exit(1); // Exit with an error code to indicate failure
+    // Run the command. If it could not be run,
+    if (minishell_run_command(&command, NULL, &status) != 0) {
+        report_error(&status); // Print an error message
     }
+}
 
-    command_two_pid = fork(); // Creates a child process for the second command
-
-    // If this is the child process,
-    if (command_two_pid == 0) {
-        close(pipefd[1]); // Close the write end of the pipe
-        dup2(pipefd[0], STDIN_FILENO); // Redirect stdin to the read end of the pipe
-        close(pipefd[0]); // Close the read end of the pipe
+/**
+ * Runs a for, while or if block typed at the prompt. More lines are read until every block is closed, then
+ * the whole block is parsed once and run by the shell itself.
+ *
+ * @param input The first line of the block.
+ */
+void run_block(const char *input) {
+    size_t length = strlen(input); // Stores the length of the text read so far
+    char *text = (char *)memstats_malloc(MEMSTATS_SHELL, length + 2); // Allocate memory to hold the text of the block
+    plan_t *plan; // Declare a pointer to hold the parsed block
+
+    // If memory could not be allocated,
+    if (text == NULL) {
+        perror("ERROR: malloc failed in run_block"); // Print an error message
+        return;
+    }
 
-        // If there is an input file to handle,
-        if (input_file) {
-            int input_fd = open(input_file, O_RDONLY); // Open the file and set the file descriptor
+    // Start the text with the first line
+    strcpy(text, input);
+    strcpy(text + length, "\n");
+    length++;
 
-            // If the file cannot be opened,
-            if (input_fd == -1) {
-                perror("ERROR: opening the input file failed"); // Print an error message
-                exit(1); // Exit with an error code to indicate failure
-            }
+    // While the block is still open, read the next line and add it to the text
+    while ((plan = plan_compile(text)) == NULL && errno == EAGAIN) {
+        char line[MAX_INPUT_LENGTH]; // Declare a buffer to hold the next line
+        printf("> "); // Print the continuation prompt
 
-            dup2(input_fd, STDIN_FILENO); // Duplicate the file descriptor to standard input
-            close(input_fd); // Close the input file descriptor
+        // If the user presses Ctrl-D (end-of-file), the block can never be closed
+        if (fgets(line, sizeof(line), stdin) == NULL) {
+            break;
         }
 
-        // If there is an output file to handle,
-        if (output_file) {
-            int output_fd = open(output_file, O_WRONLY | O_CREAT | O_TRUNC, 0644); // Open the file and set the file descriptor
-
-            // If the file cannot be opened,
-            if (output_fd == -1) {
-                perror("ERROR: opening the output file failed"); // Print an error message
-                exit(1); // Exit with an error code to indicate failure
-            }
-
-            dup2(output_fd, STDOUT_FILENO); // Duplicate the file descriptor to standard output
-            close(output_fd); // Close the output file descriptor
+        // Make room for the line and add it to the text
+        size_t line_length = strlen(line);
+        char *grown = (char *)memstats_realloc(MEMSTATS_SHELL, text, length + line_length + 2);
+        if (grown == NULL) {
+            break;
         }
-
-        // Attempts to execute the second command. If the command cannot be executed,
-        if (execvp(command_two_args[0], (char *const *)command_two_args) == -1) {
-            perror("ERROR: execvp failed to run the second command"); // Print an error message
-            exit(1); // Exit with an error code to indicate failure
+        text = grown;
+        strcpy(text + length, line);
+        length += line_length;
+
+        // Make sure the line ends with a newline
+        if (line_length == 0 || line[line_length - 1] != '\n') {
+            strcpy(text + length, "\n");
+            length++;
         }
     }
 
-    // If fork fails for the second command,
-    else if (command_two_pid < 0) {
-        perror("ERROR: fork failed the execute the first command"); // Print an error message
-        exit(1); // Exit with an error code to indicate failure
-    }
+    memstats_free(text); // Free the text, which is no longer needed once the block is parsed
 
-    // Close both ends of the pipe in the parent process
-    close(pipefd[0]);
-    close(pipefd[1]);
+    // If the block could not be parsed,
+    if (plan == NULL) {
+        fprintf(stderr, "ERROR: syntax error in the for, while or if block.\n"); // Print an error message
+        return;
+    }
 
-    // Wait for the two child processes (the first and second commands) to finish execution and store their exit status
-    waitpid(command_one_pid, &status, 0);
-    waitpid(command_two_pid, &status, 0);
+    minishell_status_t status; // Declare a structure to hold the outcome of the last command
+    minishell_run_plan(plan, NULL, &status); // Run the block (commands that cannot be run are reported)
+    plan_close(plan); // Free the parsed block
 }
 
 // START OF THE BUILT-IN COMMANDS SECTION
@@ -201,56 +218,250 @@ int cd(const char *path) {
 }
 
 /**
- * Executes each line of the given file as a command.
+ * Runs a command through the result cache. If the command was already run with the same arguments, input
+ * file and dependencies, its stored output is restored into the output file instead of running it again.
+ * Dependencies are declared in front of the command with "-d file".
  *
- * @param filename A pointer to a null-terminated string representing the name of the file to read.
- *                 The function will execute each line from this file as a command, as if it was entered
- *                 by the user at the prompt
+ * @param args A NULL-terminated array holding the optional dependencies, the command and its arguments.
+ * @param input_file A string specifying an input file for redirection (can be NULL for no redirection).
+ * @param output_file A string specifying the output file the result is written to.
+ * @param input_fd A file descriptor to use as standard input, such as a here-document (-1 for none).
+ *
+ * @return The exit status of the command, which is 0 for a cache hit.
  */
-void source(const char* filename) {
-    // Declares a file pointer and opens the given file for reading
-    FILE *file = fopen(filename, "r");
+int cache_command(const char **args, const char *input_file, const char *output_file, int input_fd) {
+    const char *dependencies[CACHE_MAX_DEPENDENCIES + 1]; // Declare an array to hold the declared dependencies
+    unsigned int dependency_count = 0; // Initialize the number of declared dependencies
+    cache_key_t key; // Declare a structure to hold the key of the result
+
+    // Collect every "-d file" in front of the command
+    while (args[0] != NULL && strcmp(args[0], "-d") == 0 && args[1] != NULL) {
+        if (dependency_count == CACHE_MAX_DEPENDENCIES) {
+            fprintf(stderr, "ERROR: cache accepts at most %d dependencies.\n", CACHE_MAX_DEPENDENCIES);
+            return 1;
+        }
+        dependencies[dependency_count++] = args[1];
+        args += 2;
+    }
+    dependencies[dependency_count] = NULL; // Null terminate the dependency array
 
-    // If the file was not successfully opened,
-    if (file == NULL) {
-        perror("ERROR: fopen failed in source"); // Print an error message
-        return; // Return
+    // If there is no command to run,
+    if (args[0] == NULL) {
+        printf("Missing command after 'cache'.\n");
+        return 1;
+    }
+
+    // If there is no output file, there is nothing to store
+    if (output_file == NULL) {
+        printf("The 'cache' command needs an output file ('> file').\n");
+        return 1;
+    }
+
+    // The assignments in front of the cache command change the environment of the command, so they are part of the key
+    unsigned int assignment_count; // Declare a variable to hold the number of assignments
+    const char **assignments = vars_assignments(&assignment_count);
+
+    // If the input cannot be identified by a file, or one of the files is missing, run the command uncached
+    if (input_fd != -1 || cache_key(args, assignments, assignment_count, input_file, dependencies, &key) != 0) {
+        return execute(args, input_file, output_file, input_fd);
     }
 
-    char line[MAX_INPUT_LENGTH]; // Define a buffer of size 255 to read each line of the file
+    // If the result was stored before, restore it instead of running the command
+    if (cache_restore(&key, output_file) == 0) {
+        cache_key_free(&key);
+        return 0;
+    }
 
-    // Iterates over the lines of the file, reading them until the end of the file is reached
-    while (fgets(line, sizeof(line), file) != NULL) {
-        size_t length = strlen(line); // Stores the length of the current line
+    int status = execute(args, input_file, output_file, input_fd); // Run the command
 
-        // Removes the newline character from the end of the line
-        if (length > 0 && line[length - 1] == '\n') {
-            line[length - 1] = '\0';
+    // Only store results of commands that succeeded
+    if (status == 0) {
+        cache_store(&key, output_file);
+    }
+
+    cache_key_free(&key);
+    return status;
+}
+
+/**
+ * Runs the cache command from a plan, which passes the command name along with the arguments.
+ *
+ * @return The exit status of the command, which is 0 for a cache hit.
+ */
+int cache_builtin(const char **args, const char *input_file, const char *output_file, int input_fd) {
+    return cache_command(args + 1, input_file, output_file, input_fd);
+}
+
+/**
+ * Runs a command once for each line of its input, keeping up to N of them running at once
+ * (parallel [-j N] [-g] command args...). Every {} in the arguments is replaced by the line. With -g, the
+ * output of each command is written out in one piece when it finishes. The lines are read from the input
+ * file or here-document if there is one, and from the shell's own input otherwise.
+ *
+ * @return The number of commands that failed (at most 101), or 1 if the command could not be run at all.
+ */
+int parallel_builtin(const char **args, const char *input_file, const char *output_file, int input_fd) {
+    unsigned int jobs = 0; // The number of commands to keep running (0 for one per processor)
+    int group = 0; // Whether the output of each command is kept together
+    FILE *items = stdin; // The stream to read the lines from
+    int output_fd = -1; // The file descriptor of the output file, if any
+    minishell_status_t status; // Declare a structure to hold the outcome of the commands
+
+    // Collect the options in front of the command
+    for (args++; args[0] != NULL && args[0][0] == '-'; args++) {
+        if (strncmp(args[0], "-j", 2) == 0) {
+            const char *value = args[0][2] != '\0' ? args[0] + 2 : *++args; // Either "-jN" or "-j N"
+            char *end; // Declare a pointer to hold the position after the number
+            unsigned long parsed = value != NULL && value[0] >= '0' && value[0] <= '9' ? strtoul(value, &end, 10) : 0;
+
+            // If the number of jobs is not a positive number, explain how to use the command
+            if (parsed == 0 || *end != '\0' || parsed > UINT_MAX) {
+                printf("The number of jobs must be a positive number. Usage: parallel [-j N] [-g] command args...\n");
+                return 1;
+            }
+            jobs = (unsigned int)parsed;
+        } else if (strcmp(args[0], "-g") == 0) {
+            group = 1;
+        } else {
+            break;
         }
+    }
 
-        vect_t *tokenizedLine; // Declare a vector to hold each tokenized line
-        tokenize(line, &tokenizedLine); // Tokenize the line
+    // If there is no command to run,
+    if (args[0] == NULL) {
+        printf("Missing command after 'parallel'. Usage: parallel [-j N] [-g] command args...\n");
+        return 1;
+    }
+
+    // If the lines come from a file or a here-document, open a stream on it
+    if (input_file != NULL) {
+        items = fopen(input_file, "r");
+    } else if (input_fd != -1) {
+        int items_fd = dup(input_fd);
+        items = items_fd != -1 ? fdopen(items_fd, "r") : NULL;
+    }
 
-        // Allocate memory to store the arguments obtained from the token vector
-        const char **args = (const char **)malloc((vect_size(tokenizedLine) + 1) * sizeof(char *));
+    // If the lines cannot be read,
+    if (items == NULL) {
+        perror("ERROR: Could not open the input of parallel"); // Print an error message
+        return 1;
+    }
 
-        // Fill the argument array with pointers to each token
-        for (unsigned int i = 0; i < vect_size(tokenizedLine); i++) {
-            args[i] = vect_get(tokenizedLine, i);
+    // If there is an output file, attempt to open it
+    if (output_file != NULL && (output_fd = open(output_file, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)) == -1) {
+        perror("ERROR: Could not open the output file"); // Print an error message
+        if (items != stdin) {
+            fclose(items);
         }
+        return 1;
+    }
+
+    minishell_io_t io = { -1, output_fd, -1 }; // Send the output of the commands to the output file, if any
+    fflush(stdout); // Make sure our own output comes before the output of the commands
+
+    // Run the commands. If the lines could not be read to the end, print an error message
+    if (minishell_parallel(args, items, jobs, group, &io, &status) != 0 && status.error != 0) {
+        report_error(&status);
+    }
 
-        // Null terminate the argument array
-        args[vect_size(tokenizedLine)] = NULL;
+    // Close the input and output
+    if (items != stdin) {
+        fclose(items);
+    }
+    if (output_fd != -1) {
+        close(output_fd);
+    }
+
+    return status.exit_status == -1 ? 1 : status.exit_status;
+}
+
+/**
+ * Runs the cd command from a plan, which passes the command name along with the arguments.
+ *
+ * @return 0 for success, 1 for an error.
+ */
+int cd_builtin(const char **args, const char *input_file, const char *output_file, int input_fd) {
+    // If there is no directory to change to,
+    if (args[1] == NULL) {
+        printf("Missing directory after 'cd' command.\n");
+        return 1;
+    }
+    return cd(args[1]);
+}
+
+/**
+ * Prints how much memory the shell allocated, per subsystem, and how much it grew since the last report, to
+ * the output file if one is given and to standard output otherwise.
+ *
+ * @return 0 for success, 1 if the output file could not be opened.
+ */
+int memstats_builtin(const char **args, const char *input_file, const char *output_file, int input_fd) {
+    // If there is no output file, print the report to the terminal
+    if (output_file == NULL) {
+        memstats_print(stdout);
+        return 0;
+    }
+
+    FILE *out = fopen(output_file, "w"); // Open the output file
+
+    // If the output file could not be opened,
+    if (out == NULL) {
+        perror("ERROR: Could not open the output file"); // Print an error message
+        return 1;
+    }
+
+    memstats_print(out);
+    fclose(out);
+    return 0;
+}
+
+/**
+ * Prints the memory report to standard error when the shell exits, if $MINISHELL_MEMSTATS is set.
+ */
+void memstats_at_exit() {
+    // If the report was not asked for, there is nothing to print
+    if (vars_lookup("MINISHELL_MEMSTATS") == NULL) {
+        return;
+    }
+
+    fprintf(stderr, "Memory used by the shell:\n");
+    memstats_print(stderr);
+}
+
+/**
+ * Executes each line of the given file as a command.
+ *
+ * The file is compiled once into a plan of pre-split commands, redirections and for, while and if blocks,
+ * which is kept in the cache store and memory-mapped on later runs, so an unchanged file is not tokenized
+ * again.
+ *
+ * @param filename A pointer to a null-terminated string representing the name of the file to read.
+ *                 The function will execute each line from this file as a command, as if it was entered
+ *                 by the user at the prompt
+ */
+void source(const char* filename) {
+    // Open the compiled plan of the file, compiling it if needed
+    plan_t *plan = plan_open(filename);
 
-        // Execute the argument array
-        execute(args, NULL, NULL);
+    // If the file has a syntax error, say so rather than blaming the file itself
+    if (plan == NULL && errno == EINVAL) {
+        fprintf(stderr, "ERROR: syntax error in %s (an unmatched double quote, or a for, while or if block that is not closed properly).\n", filename);
+        return;
+    }
 
-        vect_delete(tokenizedLine); // Free all the memory used by the tokens
-        free(args); // Free the memory used by the argument array
+    // If the file could not be read,
+    if (plan == NULL) {
+        perror("ERROR: could not read the file in source"); // Print an error message
+        return; // Return
     }
 
-    // Close the file once all lines have been processed
-    fclose(file);
+    minishell_status_t status; // Declare a structure to hold the outcome of the last command
+
+    // Execute the commands of the plan (commands that cannot be run are reported through report_error)
+    minishell_run_plan(plan, NULL, &status);
+
+    // Close the plan once all commands have been executed
+    plan_close(plan);
 }
 
 /**
@@ -286,11 +497,28 @@ void help() {
     printf("cd: Changes the current working directory of the shell to the path specified as the argument.\n");
     printf("source: Executes each line of the given file as a command.\n");
     printf("prev: Prints the previous command line and executes it again.\n");
+    printf("cache: Runs a command with its output redirected to a file, reusing the stored output if the command, its input and its dependencies (-d file) are unchanged.\n");
+    printf("export: Sets and exports variables given as NAME=value, or exports the variables named.\n");
+    printf("unset: Removes the variables named.\n");
+    printf("NAME=value: Sets a shell variable, or only sets it for the command that follows. $NAME and ${NAME} are expanded in commands.\n");
+    printf("MINISHELL_PIPE_SIZE, MINISHELL_PIPE_DIRECT, MINISHELL_PIPE_REPORT: Set a pipe capacity (bytes, or max), packet mode (1) and per-stage throughput reports (1) for every pipeline, or for one pipeline when assigned in front of it.\n");
+    printf("parallel: Runs 'parallel [-j N] [-g] command {}' once for each line of its input, with {} replaced by the line and up to N commands running at once (-g keeps the output of each command together).\n");
+    printf("memstats: Prints how much memory the shell allocated, per subsystem, and the change since the last report.\n");
     printf("help: Explains all the built-in commands available in our shell.\n");
+    printf("for/while/if: Runs 'for x in words; do ...; done', 'while cmd; do ...; done' and 'if cmd; then ...; else ...; fi' inside the shell, with $x replaced by the current word.\n");
 }
 
 // END OF THE BUILT-IN COMMANDS SECTION
 
+// The built-in commands that can also be run from sourced files and blocks
+const minishell_builtin_t builtins[] = {
+    { "cache", cache_builtin },
+    { "cd", cd_builtin },
+    { "memstats", memstats_builtin },
+    { "parallel", parallel_builtin },
+    { NULL, NULL }
+};
+
 int main(int argc, char **argv) {
     printf("Welcome to mini-shell.\n"); // Prints the welcome message
     char input[MAX_INPUT_LENGTH];  // Declare an array to store user input
@@ -299,6 +527,13 @@ int main(int argc, char **argv) {
     char previous_command[MAX_INPUT_LENGTH]; // Declare an array to store the previous command entered by the user
     char *prev_command = NULL; // Initializes a pointer to be used to track the previous command
 
+    // Let the library run our built-in commands and report commands that could not be run
+    minishell_hooks_t hooks = { builtins, report_error, report_throughput };
+    minishell_set_hooks(&hooks);
+
+    // Print the memory report when the shell exits, if $MINISHELL_MEMSTATS is set by then
+    atexit(memstats_at_exit);
+
     // Starts an infinite loop, where the shell continually waits for user input and processes it
     while (1) {
         printf("shell $ "); // Print the shell prompt
@@ -316,15 +551,6 @@ int main(int argc, char **argv) {
             help();
         } 
 
-        // If the cd command is called,
-        else if (strncmp(input, "cd ", 3) == 0) {
-            // Change directory command
-            const char *directory = input + 3;
-            if (cd(directory) != 0) {
-                fprintf(stderr, "Failed to change directory to %s\n", directory);
-            }
-        } 
-
         // If the prev command is called,
         else if (strcmp(input, "prev") == 0) {
             // Execute the previous command
@@ -346,6 +572,11 @@ int main(int argc, char **argv) {
             }
         }
 
+        // If a for, while or if block is started,
+        else if (strncmp(input, "for ", 4) == 0 || strncmp(input, "while ", 6) == 0 || strncmp(input, "if ", 3) == 0) {
+            run_block(input);
+        }
+
         // Otherwise, 
         else {
             char *command = strtok(input, ";");  // Tokenize any commands that are separated by a semicolon
@@ -354,15 +585,63 @@ int main(int argc, char **argv) {
             while (command != NULL) {
                 char *input_file = NULL; // Set the input file to NULL
                 char *output_file = NULL; // Set the output file to NULL
+                char *here_data = NULL; // Set the contents of the here-document to none
+                size_t here_length = 0; // Declare a variable to hold the length of the here-document
 
                 strcpy(previous_command, command); // Set the previous command variable to the current command
                 prev_command = previous_command; // Copy the current command for later use
 
                 // Set variables to indicate whether there is input/output redirection or piping to handle
+                char *here_string = strstr(command, "<<<");
+                char *here_document = here_string ? NULL : strstr(command, "<<");
                 char *input_redirect = strstr(command, "<");
                 char *output_redirect = strstr(command, ">");
                 char *pipe_operator = strstr(command, "|");
 
+                // Handle a here-string, which feeds the given word followed by a newline to the command
+                if (here_string) {
+                    *here_string = '\0'; // Null-terminates the command string at the position where the '<<<' was found
+                    if (pipe_operator) {
+                        *pipe_operator = '\0'; // Keep the pipe operator out of the word
+                    }
+                    char *word = parse_word(here_string + 3); // Find the word to feed to the command
+
+                    // Build the contents of the here-string
+                    size_t length = word ? strlen(word) : 0;
+                    here_data = (char *)memstats_malloc(MEMSTATS_SHELL, length + 1);
+                    if (here_data != NULL) {
+                        memcpy(here_data, word ? word : "", length);
+                        here_data[length] = '\n';
+                        here_length = length + 1;
+                    }
+
+                    if (pipe_operator) {
+                        *pipe_operator = '|'; // Restore the pipe operator
+                    }
+                    input_redirect = NULL; // The '<' characters belong to the here-string
+                }
+
+                // Handle a here-document, which feeds the following lines up to the delimiter to the command
+                else if (here_document) {
+                    *here_document = '\0'; // Null-terminates the command string at the position where the '<<' was found
+                    if (pipe_operator) {
+                        *pipe_operator = '\0'; // Keep the pipe operator out of the delimiter
+                    }
+                    char *delimiter = parse_word(here_document + 2); // Find the delimiter that ends the here-document
+
+                    // If there is no delimiter, the here-document cannot be read
+                    if (delimiter == NULL) {
+                        fprintf(stderr, "ERROR: Missing delimiter after '<<'.\n");
+                    } else {
+                        here_data = read_here_document(stdin, delimiter, &here_length); // Read the body from the terminal
+                    }
+
+                    if (pipe_operator) {
+                        *pipe_operator = '|'; // Restore the pipe operator
+                    }
+                    input_redirect = NULL; // The '<' characters belong to the here-document
+                }
+
                 // Handle input redirection
                 if (input_redirect) {
                     *input_redirect = '\0'; // Null-terminates the command string at the position where the '<' character was found
@@ -379,10 +658,10 @@ int main(int argc, char **argv) {
                 if (pipe_operator) {
                     *pipe_operator = '\0'; // Replace the pipe character with a null terminator to split the command
                     
-                    tokenize(command, &tokens); // Tokenize the first command
+                    int unmatched = tokenize(command, &tokens); // Tokenize the first command
                     
                     // Allocate memory to hold the arguments of the first command
-                    const char **command_one_args = (const char **)malloc((vect_size(tokens) + 1) * sizeof(char *));
+                    const char **command_one_args = (const char **)memstats_malloc(MEMSTATS_SHELL, (vect_size(tokens) + 1) * sizeof(char *));
                     
                     // Copy each token from the tokens vector to the command one array
                     for (unsigned int i = 0; i < vect_size(tokens); i++) {
@@ -392,10 +671,10 @@ int main(int argc, char **argv) {
                     // Null terminate the command one array
                     command_one_args[vect_size(tokens)] = NULL;
 
-                    tokenize(pipe_operator + 1, &tokens); // Tokenize the second command
+                    unmatched |= tokenize(pipe_operator + 1, &tokens); // Tokenize the second command
                     
                     // Allocate memory to hold the arguments of the second command
-                    const char **command_two_args = (const char **)malloc((vect_size(tokens) + 1) * sizeof(char *));
+                    const char **command_two_args = (const char **)memstats_malloc(MEMSTATS_SHELL, (vect_size(tokens) + 1) * sizeof(char *));
                     
                     // Copy each token from the tokens vector to the command two array
                     for (unsigned int i = 0; i < vect_size(tokens); i++) {
@@ -405,20 +684,27 @@ int main(int argc, char **argv) {
                     // Null terminate the command two array
                     command_two_args[vect_size(tokens)] = NULL;
 
-                    // Execute the piped command
-                    execute_piped(command_one_args, command_two_args, input_file, output_file);
+                    // If a double quote was not matched, the command cannot be run
+                    if (unmatched) {
+                        fprintf(stderr, "ERROR: Unmatched double quote.\n");
+                    }
+
+                    // Otherwise, execute the piped command
+                    else {
+                        run_parsed(command_one_args, command_two_args, input_file, output_file, here_data, here_length);
+                    }
 
-                    free(command_one_args); // Free the memory allocated by the pipe for the first command
-                    free(command_two_args); // Free the memory allocated by the pipe for the second command
+                    memstats_free(command_one_args); // Free the memory allocated by the pipe for the first command
+                    memstats_free(command_two_args); // Free the memory allocated by the pipe for the second command
                 } 
                 
                 // If there are no advanced shell features handle,
                 else {
                     // Tokenize the individual command
-                    tokenize(command, &tokens);
+                    int unmatched = tokenize(command, &tokens);
                     
                     // Allocate memory to store the arguments of the command
-                    const char **args = (const char **)malloc((vect_size(tokens) + 1) * sizeof(char *));
+                    const char **args = (const char **)memstats_malloc(MEMSTATS_SHELL, (vect_size(tokens) + 1) * sizeof(char *));
                     
                     // Copy the arguments of the tokens vector to the argument array
                     for (unsigned int i = 0; i < vect_size(tokens); i++) {
@@ -428,20 +714,29 @@ int main(int argc, char **argv) {
                     // Null terminate the arguments array
                     args[vect_size(tokens)] = NULL;
 
-                    // Execute the command with the arguments
-                    execute(args, input_file, output_file);
+                    // If a double quote was not matched, the command cannot be run
+                    if (unmatched) {
+                        fprintf(stderr, "ERROR: Unmatched double quote.\n");
+                    }
+
+                    // Otherwise, execute the command with the arguments (built-in commands such as cache included)
+                    else {
+                        run_parsed(args, NULL, input_file, output_file, here_data, here_length);
+                    }
 
                     // Free memory used by the tokens and arguments
                     for (unsigned int i = 0; i < vect_size(tokens); i++) {
                         char *token_copy = vect_get_copy(tokens, i);
-                        free(token_copy);
+                        memstats_free(token_copy);
                     }
                     
-                    free(args); // Free the memory used by the argument array
+                    memstats_free(args); // Free the memory used by the argument array
                 }
 
                 vect_delete(tokens); // Free all the memory used by the tokens
 
+                memstats_free(here_data); // Free the contents of the here-document now that the command has read it
+
                 command = strtok(NULL, ";"); // Get the next command
             }
         }
@@ -4,6 +4,7 @@
 
 #include "vect.h"
 #include "tokens.h"
+#include "memstats.h"
 
 // Entry point of the program for tokenizing and printing the output
 int main(int argc, char **argv) {
@@ -12,18 +13,23 @@ int main(int argc, char **argv) {
     // Check if the input can be read from standard input
     if (fgets(input, MAX_INPUT_LENGTH, stdin) != NULL) {
         vect_t *tokens; // Declare a pointer to a vector for storing tokens
-        tokenize(input, &tokens); // Tokenize the input and store those tokens in the vector
+        // Tokenize the input and store those tokens in the vector. If a double quote was not matched,
+        if (tokenize(input, &tokens) != 0) {
+            fprintf(stderr, "ERROR: Unmatched double quote.\n"); // Print an error
+            vect_delete(tokens); // Free memory used by the token vector
+            return 1; // Return an exit code of 1 to indicate failure
+        }
 
         // Iterate through the tokens and print each one, followed by a new line
         for (unsigned int i = 0; i < vect_size(tokens); i++) {
             const char *token = vect_get(tokens, i);
-            printf("%s\n", token);
+            printf("%s\n", token[0] == TOKENS_QUOTED ? token + 1 : token); // Leave out the mark of a quoted token
         }
 
         // Free memory used by the individual tokens
         for (unsigned int i = 0; i < vect_size(tokens); i++) {
             char *token_copy = vect_get_copy(tokens, i);
-            free(token_copy);
+            memstats_free(token_copy);
         }
 
         vect_delete(tokens); // Free memory used by the token vector
@@ -6,11 +6,20 @@
 
 #include "vect.h"
 #include "tokens.h"
+#include "memstats.h"
 
 // Splits up an input line into meaningful tokens
-void tokenize(const char *input, vect_t **tokens) {
+int tokenize(const char *input, vect_t **tokens) {
+    int previous_owner = memstats_attribute(MEMSTATS_TOKENS); // Charge the allocations of the vector to the tokenizer
     *tokens = vect_new(); // Create a new string vector to store tokens
     int i = 0; // Initialize an index to be used when traversing the input string
+    char *text = (char *)memstats_malloc(MEMSTATS_TOKENS, strlen(input) + 2); // Room for the longest possible word and a mark
+
+    // If memory could not be allocated, nothing can be tokenized
+    if (text == NULL) {
+        memstats_attribute(previous_owner); // Stop charging allocations to the tokenizer
+        return 1;
+    }
 
     // While the end of the input string is not reached, tokenize the input
     while (input[i] != '\0') {
@@ -59,7 +68,7 @@ void tokenize(const char *input, vect_t **tokens) {
         // If the current character is '"', process the quoted string
         else if (input[i] == '"') {
             i++; // Move the index to the first character after the quote
-            char quoted[256]; // Create an array to hold the quoted string
+            char *quoted = text + 1; // Use the shared buffer to hold the quoted string, leaving room for a mark
             int j = 0; // Initialize an index for the quoted array
 
             // Start a loop that continues until either the ending quote is encountered or the end of the input string is reached
@@ -72,20 +81,26 @@ void tokenize(const char *input, vect_t **tokens) {
             // If an ending quote is found,
             if (input[i] == '"') {
                 quoted[j] = '\0'; // Null terminate the quoted string to mark the end
+
+                // If the string refers to a variable, mark it as quoted so it is kept even if it expands to nothing
+                if (strchr(quoted, '$') != NULL) {
+                    *--quoted = TOKENS_QUOTED;
+                }
                 vect_add(*tokens, quoted); // Add the quoted string as a token to the token vector
                 i++; // Move the index to the character in the input string that follows the closing quote
             }
 
             // If an ending quote was not found,
             else {
-                fprintf(stderr, "ERROR: Unmatched double quote.\n"); // Print an error
-                exit(1); // Exit with an error code to indicate failure
+                memstats_free(text); // Free the buffer that held the words
+                memstats_attribute(previous_owner); // Stop charging allocations to the tokenizer
+                return 1; // Return an error code to indicate failure
             }
         }
 
         // If no tokens were recognized, treat this character as the start of a word
         else {
-            char word[256]; // Create an array to hold the word
+            char *word = text; // Use the shared buffer to hold the word
             int k = 0; // Initialize an index for the word array
 
             // Start a loop that continues until a token is encountered or the end of the input string is reached
@@ -103,4 +118,8 @@ void tokenize(const char *input, vect_t **tokens) {
             vect_add(*tokens, word); // Add the word string as a token to the token vector
         }
     }
+
+    memstats_free(text); // Free the buffer that held the words
+    memstats_attribute(previous_owner); // Stop charging allocations to the tokenizer
+    return 0; // Return 0 to indicate success
 }
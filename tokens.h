@@ -6,16 +6,21 @@
 #include "vect.h" // Include the vect library from assignment 4
 
 #define MAX_INPUT_LENGTH 255 // Define the maximum input string length to be 255
+#define TOKENS_QUOTED '\001' // Starts a quoted token that refers to a variable, so it is kept if it expands to nothing
 
 /**
  * Splits up an input line into meaningful tokens
  *
  * The tokens (, ), <, >, ;, |, and the whitespace characters (space ' ', tab '\t', newline '\n') are special
  * Whitespace is not a token, but might separate tokens
+ * A quoted token that holds a '$' starts with TOKENS_QUOTED, which variable expansion removes
  *
  * @param input The input string to be tokenized
  * @param tokens A pointer to a string vector where the tokens will be stored
+ *
+ * @return 0 for success, 1 if a double quote was not matched or memory could not be allocated (the vector
+ *         still has to be deleted)
  */
-void tokenize(const char *input, vect_t **tokens);
+int tokenize(const char *input, vect_t **tokens);
 
 #endif
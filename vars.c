@@ -0,0 +1,346 @@
+// A source file that defines the shell variables, which are expanded in commands and exported to them
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hash.h"
+#include "vars.h"
+#include "memstats.h"
+
+extern char **environ; // The environment the shell was started with
+
+/** A variable of the table. */
+typedef struct variable {
+    struct variable *next;      /* The next variable in the same bucket. */
+    unsigned long long hash;    /* The hash of the name. */
+    size_t length;              /* The number of characters of the name. */
+    int exported;               /* Whether the variable is given to commands. */
+    char *text;                 /* The variable as NAME=value, which is also its entry in the environment. */
+} variable_t;
+
+static variable_t **buckets; // The buckets of the table, each holding a list of variables
+static size_t bucket_count; // The number of buckets (a power of two)
+static size_t variable_count; // The number of variables in the table
+static char **environment; // The environment given to commands, pointing at the text of the exported variables
+static size_t environment_capacity; // The number of entries the environment can hold
+static int environment_stale = 1; // Whether an exported variable changed since the environment was built
+static const char **assignments; // The NAME=value words in front of the built-in command that is running
+static unsigned int assignment_count; // The number of those words
+static char **assigned_environment; // The environment with those words on top, built when it is first needed
+
+/** Notes that an exported variable changed, so every environment built from the table is out of date. */
+static void changed() {
+    environment_stale = 1;
+    memstats_free(assigned_environment);
+    assigned_environment = NULL;
+}
+
+/** Fills the table with the environment the shell was started with, the first time the table is used. */
+static int load() {
+    if (buckets != NULL) {
+        return 0;
+    }
+
+    buckets = (variable_t **)memstats_calloc(MEMSTATS_VARS, VARS_INITIAL_BUCKETS, sizeof(variable_t *));
+
+    // If memory could not be allocated, return an error
+    if (buckets == NULL) {
+        return 1;
+    }
+    bucket_count = VARS_INITIAL_BUCKETS;
+
+    // Copy every variable of the environment (entries that are not NAME=value are left out)
+    for (unsigned int i = 0; environ != NULL && environ[i] != NULL; i++) {
+        vars_assign(environ[i], 1);
+    }
+
+    return 0;
+}
+
+/** Finds the link that points at the variable with the given name, or at the end of its bucket if it is not set. */
+static variable_t **find(const char *name, size_t length, unsigned long long hash) {
+    variable_t **link = &buckets[hash & (bucket_count - 1)];
+
+    while (*link != NULL && ((*link)->hash != hash || (*link)->length != length
+                             || memcmp((*link)->text, name, length) != 0)) {
+        link = &(*link)->next;
+    }
+
+    return link;
+}
+
+/** Doubles the number of buckets once the table is three quarters full, so the lists stay short. */
+static void grow() {
+    if (variable_count + 1 <= bucket_count / 4 * 3) {
+        return;
+    }
+
+    variable_t **grown = (variable_t **)memstats_calloc(MEMSTATS_VARS, bucket_count * 2, sizeof(variable_t *));
+
+    // If memory could not be allocated, keep the current buckets (lookups just get slower)
+    if (grown == NULL) {
+        return;
+    }
+
+    // Move every variable to its bucket in the new table
+    for (size_t i = 0; i < bucket_count; i++) {
+        while (buckets[i] != NULL) {
+            variable_t *variable = buckets[i];
+            buckets[i] = variable->next;
+            variable->next = grown[variable->hash & (bucket_count * 2 - 1)];
+            grown[variable->hash & (bucket_count * 2 - 1)] = variable;
+        }
+    }
+
+    memstats_free(buckets);
+    buckets = grown;
+    bucket_count *= 2;
+}
+
+// Finds the length of the variable name at the start of a string
+size_t vars_name_length(const char *string) {
+    size_t length = 0;
+
+    while (string[length] == '_' || (string[length] >= 'a' && string[length] <= 'z')
+           || (string[length] >= 'A' && string[length] <= 'Z')
+           || (length > 0 && string[length] >= '0' && string[length] <= '9')) {
+        length++;
+    }
+
+    return length;
+}
+
+// Looks up the value of a variable
+const char *vars_get(const char *name, size_t length) {
+    // The assignments in front of the running built-in command hide the shell variables
+    for (unsigned int i = assignment_count; i > 0; i--) {
+        if (strncmp(assignments[i - 1], name, length) == 0 && assignments[i - 1][length] == '=') {
+            return assignments[i - 1] + length + 1;
+        }
+    }
+
+    if (load() != 0) {
+        return NULL;
+    }
+
+    variable_t *variable = *find(name, length, hash_bytes(HASH_INIT, name, length));
+    return variable != NULL ? variable->text + length + 1 : NULL;
+}
+
+// Looks up the value of a variable by its null-terminated name
+const char *vars_lookup(const char *name) {
+    return vars_get(name, strlen(name));
+}
+
+// Sets a variable
+int vars_set(const char *name, size_t length, const char *value, int exported) {
+    if (load() != 0) {
+        return 1;
+    }
+
+    size_t value_length = strlen(value);
+    char *text = (char *)memstats_malloc(MEMSTATS_VARS, length + value_length + 2); // Room for NAME=value
+
+    // If memory could not be allocated, return an error
+    if (text == NULL) {
+        return 1;
+    }
+
+    // Build the NAME=value text of the variable
+    memcpy(text, name, length);
+    text[length] = '=';
+    memcpy(text + length + 1, value, value_length + 1);
+
+    unsigned long long hash = hash_bytes(HASH_INIT, name, length);
+    variable_t **link = find(name, length, hash);
+
+    // If the variable is not set yet, add it to the table
+    if (*link == NULL) {
+        variable_t *variable = (variable_t *)memstats_malloc(MEMSTATS_VARS, sizeof(variable_t));
+        if (variable == NULL) {
+            memstats_free(text);
+            return 1;
+        }
+
+        grow();
+        link = find(name, length, hash); // The buckets may have moved
+        variable->next = NULL;
+        variable->hash = hash;
+        variable->length = length;
+        variable->exported = 0;
+        variable->text = NULL;
+        *link = variable;
+        variable_count++;
+    }
+
+    // Replace the value of the variable
+    memstats_free((*link)->text);
+    (*link)->text = text;
+    (*link)->exported |= exported;
+
+    // The environment points at the old text of an exported variable, so it has to be rebuilt
+    if ((*link)->exported) {
+        changed();
+    }
+
+    return 0;
+}
+
+// Sets a variable from an assignment of the form NAME=value
+int vars_assign(const char *assignment, int exported) {
+    size_t length = vars_name_length(assignment);
+
+    // If the assignment does not start with a name followed by '=', it is not valid
+    if (length == 0 || assignment[length] != '=') {
+        return 1;
+    }
+
+    return vars_set(assignment, length, assignment + length + 1, exported);
+}
+
+// Exports a variable that is already set
+void vars_export(const char *name, size_t length) {
+    if (load() != 0) {
+        return;
+    }
+
+    variable_t *variable = *find(name, length, hash_bytes(HASH_INIT, name, length));
+
+    // If the variable is set and not exported yet, it joins the environment
+    if (variable != NULL && !variable->exported) {
+        variable->exported = 1;
+        changed();
+    }
+}
+
+// Removes a variable
+void vars_unset(const char *name, size_t length) {
+    if (load() != 0) {
+        return;
+    }
+
+    variable_t **link = find(name, length, hash_bytes(HASH_INIT, name, length));
+    variable_t *variable = *link;
+
+    // If the variable is not set, there is nothing to remove
+    if (variable == NULL) {
+        return;
+    }
+
+    // If the variable was exported, it has to leave the environment
+    if (variable->exported) {
+        changed();
+    }
+
+    *link = variable->next; // Unlink the variable from its bucket
+    variable_count--;
+    memstats_free(variable->text);
+    memstats_free(variable);
+}
+
+/** Gets the environment of the exported variables, rebuilding it only if one of them changed. */
+static char **exported_environ() {
+    if (load() != 0) {
+        return NULL;
+    }
+
+    // If no exported variable changed since the environment was built, it can be used as it is
+    if (!environment_stale) {
+        return environment;
+    }
+
+    // If the environment might not hold every variable, make it larger
+    if (environment == NULL || variable_count + 1 > environment_capacity) {
+        char **grown = (char **)memstats_realloc(MEMSTATS_VARS, environment, (variable_count + 1) * 2 * sizeof(char *));
+        if (grown == NULL) {
+            return NULL;
+        }
+        environment = grown;
+        environment_capacity = (variable_count + 1) * 2;
+    }
+
+    // Point at the text of every exported variable
+    size_t count = 0;
+    for (size_t i = 0; i < bucket_count; i++) {
+        for (variable_t *variable = buckets[i]; variable != NULL; variable = variable->next) {
+            if (variable->exported) {
+                environment[count++] = variable->text;
+            }
+        }
+    }
+    environment[count] = NULL;
+
+    environment_stale = 0;
+    return environment;
+}
+
+// Gets the environment to give to commands
+char *const *vars_environ() {
+    // If a built-in command is running with assignments in front of it, they go on top of the exported variables
+    if (assignment_count > 0) {
+        if (assigned_environment == NULL) {
+            assigned_environment = vars_environ_with(assignments, assignment_count);
+        }
+        return assigned_environment;
+    }
+
+    return exported_environ();
+}
+
+// Builds a one-off environment that holds the given assignments on top of the exported variables
+char **vars_environ_with(const char **assignments, unsigned int count) {
+    char *const *base = exported_environ(); // The environment without the assignments
+
+    // If the environment could not be built, neither can this one
+    if (base == NULL) {
+        return NULL;
+    }
+
+    unsigned int base_count = 0;
+    while (base[base_count] != NULL) {
+        base_count++;
+    }
+
+    char **merged = (char **)memstats_malloc(MEMSTATS_VARS, (base_count + count + 1) * sizeof(char *));
+
+    // If memory could not be allocated, return an error
+    if (merged == NULL) {
+        return NULL;
+    }
+
+    // Copy the exported variables, leaving out the ones that are assigned
+    unsigned int merged_count = 0;
+    for (unsigned int i = 0; i < base_count; i++) {
+        size_t length = strcspn(base[i], "=") + 1; // The length of the name, including the '='
+        unsigned int j = 0;
+        while (j < count && strncmp(base[i], assignments[j], length) != 0) {
+            j++;
+        }
+        if (j == count) {
+            merged[merged_count++] = base[i];
+        }
+    }
+
+    // Add the assignments themselves
+    for (unsigned int j = 0; j < count; j++) {
+        merged[merged_count++] = (char *)assignments[j];
+    }
+    merged[merged_count] = NULL;
+
+    return merged;
+}
+
+// Makes the assignments in front of a built-in command visible while it runs
+void vars_set_assignments(const char **words, unsigned int count) {
+    assignments = words;
+    assignment_count = count;
+    memstats_free(assigned_environment);
+    assigned_environment = NULL;
+}
+
+// Gets the assignments in front of the running built-in command
+const char **vars_assignments(unsigned int *count) {
+    *count = assignment_count;
+    return assignments;
+}
@@ -0,0 +1,123 @@
+// A header file that declares the shell variables, which are expanded in commands and exported to them
+//
+// The variables live in a hash table owned by the shell. The table starts out as a copy of the environment the
+// shell was started with. The environment array handed to commands is kept up to date alongside the table and
+// is only rebuilt after an exported variable changed, not every time a command is run.
+
+#ifndef _VARS_H
+#define _VARS_H
+
+#include <stddef.h>
+
+#define VARS_INITIAL_BUCKETS 64 // Number of buckets the table starts with (always a power of two)
+
+/**
+ * Finds the length of the variable name at the start of a string. Names are made of letters, digits and
+ * underscores, and do not start with a digit.
+ *
+ * @param string The string to look at.
+ *
+ * @return The number of characters of the name, or 0 if the string does not start with a name.
+ */
+size_t vars_name_length(const char *string);
+
+/**
+ * Looks up the value of a variable.
+ *
+ * @param name The name of the variable, which does not have to be null-terminated.
+ * @param length The number of characters of the name.
+ *
+ * @return The value of the variable, or NULL if it is not set. The value stays valid until the variable is
+ *         set again or unset.
+ */
+const char *vars_get(const char *name, size_t length);
+
+/**
+ * Looks up the value of a variable by its null-terminated name. Settings of the shell are read this way rather
+ * than with getenv, so that they can be changed with export or assigned in front of a command.
+ *
+ * @param name The null-terminated name of the variable.
+ *
+ * @return The value of the variable, or NULL if it is not set.
+ */
+const char *vars_lookup(const char *name);
+
+/**
+ * Sets a variable. A variable that was already exported stays exported.
+ *
+ * @param name The name of the variable, which does not have to be null-terminated.
+ * @param length The number of characters of the name.
+ * @param value The null-terminated value of the variable.
+ * @param exported Whether the variable should be exported to commands from now on.
+ *
+ * @return 0 for success, 1 if memory could not be allocated.
+ */
+int vars_set(const char *name, size_t length, const char *value, int exported);
+
+/**
+ * Sets a variable from an assignment of the form NAME=value.
+ *
+ * @param assignment The null-terminated assignment.
+ * @param exported Whether the variable should be exported to commands from now on.
+ *
+ * @return 0 for success, 1 if the assignment is not valid or memory could not be allocated.
+ */
+int vars_assign(const char *assignment, int exported);
+
+/**
+ * Exports a variable that is already set. Exporting a variable that is not set does nothing.
+ *
+ * @param name The name of the variable, which does not have to be null-terminated.
+ * @param length The number of characters of the name.
+ */
+void vars_export(const char *name, size_t length);
+
+/**
+ * Removes a variable. Removing a variable that is not set does nothing.
+ *
+ * @param name The name of the variable, which does not have to be null-terminated.
+ * @param length The number of characters of the name.
+ */
+void vars_unset(const char *name, size_t length);
+
+/**
+ * Gets the environment to give to commands, holding one NAME=value string for each exported variable, and the
+ * assignments in front of the running built-in command if there are any (see vars_set_assignments).
+ *
+ * @return The NULL-terminated environment, or NULL if memory could not be allocated. It stays valid until the
+ *         next change to an exported variable.
+ */
+char *const *vars_environ();
+
+/**
+ * Builds a one-off environment that holds the given assignments on top of the exported variables, for a
+ * command that is run as "NAME=value command".
+ *
+ * @param assignments The NAME=value strings to add, which replace any exported variable with the same name.
+ * @param count The number of assignments.
+ *
+ * @return The NULL-terminated environment, which the caller frees with memstats_free, or NULL if memory could
+ *         not be allocated. The strings belong to the variables and to the assignments.
+ */
+char **vars_environ_with(const char **assignments, unsigned int count);
+
+/**
+ * Makes the NAME=value assignments in front of a built-in command visible while it runs, as if they were
+ * exported variables: vars_get and vars_environ see them, so commands the built-in command starts get them in
+ * their environment. The shell variables themselves are left unchanged.
+ *
+ * @param words The assignments, which must stay valid until they are replaced (can be NULL when count is 0).
+ * @param count The number of assignments, or 0 once the built-in command is done.
+ */
+void vars_set_assignments(const char **words, unsigned int count);
+
+/**
+ * Gets the assignments in front of the running built-in command, so they can be restored after a nested one.
+ *
+ * @param count A pointer to where the number of assignments will be stored.
+ *
+ * @return The assignments (NULL or unused when the count is 0).
+ */
+const char **vars_assignments(unsigned int *count);
+
+#endif
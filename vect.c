@@ -14,6 +14,7 @@
 #include <string.h>
 
 #include "vect.h"
+#include "memstats.h"
 
 /** Main data structure for the vector. */
 struct vect {
@@ -25,7 +26,7 @@ struct vect {
 /** Construct a new empty vector. */
 vect_t *vect_new() {
     // Allocate memory for the vector
-    vect_t *v = (vect_t*)malloc(sizeof(vect_t));
+    vect_t *v = (vect_t*)memstats_malloc(memstats_owner(MEMSTATS_VECT), sizeof(vect_t));
 
     // If memory could not be allocated, return NULL
     if (v == NULL) {
@@ -33,11 +34,11 @@ vect_t *vect_new() {
     }
 
     // Allocate memory for the data of the vector
-    v->data = (char**)malloc(VECT_INITIAL_CAPACITY * sizeof(char*));
+    v->data = (char**)memstats_malloc(memstats_owner(MEMSTATS_VECT), VECT_INITIAL_CAPACITY * sizeof(char*));
 
     // If memory could not be allocated, free the vector and return NULL
     if (v->data == NULL) {
-        free(v);
+        memstats_free(v);
         return NULL;
     }
 
@@ -61,14 +62,14 @@ void vect_delete(vect_t *v) {
 
     // Free the data inside the data array from memory
     for (unsigned int i = 0; i < v->size; i++) {
-        free(v->data[i]);
+        memstats_free(v->data[i]);
     }
 
     // Free the data array itself from memory
-    free(v->data);
+    memstats_free(v->data);
 
     // Free the vector from memory
-    free(v);
+    memstats_free(v);
 }
 
 /** Get the element at the given index. */
@@ -90,7 +91,7 @@ char *vect_get_copy(vect_t *v, unsigned int idx) {
     const char *element = vect_get(v, idx);
 
     // Allocate memory for a copy of the element
-    char *copy = (char*)malloc(strlen(element) + 1); // The length of the element + 1 (to account for the null terminator)
+    char *copy = (char*)memstats_malloc(memstats_owner(MEMSTATS_VECT), strlen(element) + 1); // The length of the element + 1 (to account for the null terminator)
 
     // If memory could not be allocated, return NULL
     if (copy == NULL) {
@@ -112,11 +113,11 @@ void vect_set(vect_t *v, unsigned int idx, const char *elt) {
 
     // If there is already an element at the given index, free it from memory
     if (v->data[idx] != NULL) {
-        free(v->data[idx]);
+        memstats_free(v->data[idx]);
     }
 
     // Allocate memory for the given element
-    char *element = (char*)malloc(strlen(elt) + 1); // The length of the element + 1 (to account for the null terminator)
+    char *element = (char*)memstats_malloc(memstats_owner(MEMSTATS_VECT), strlen(elt) + 1); // The length of the element + 1 (to account for the null terminator)
     // If memory could not be allocated, return
     if (element == NULL) {
         return;
@@ -143,7 +144,7 @@ void vect_add(vect_t *v, const char *elt) {
         }
 
         // Otherwise, reallocate memory for the resized data array
-        char** updatedData = (char**)realloc(v->data, updatedCapacity * sizeof(char*));
+        char** updatedData = (char**)memstats_realloc(memstats_owner(MEMSTATS_VECT), v->data, updatedCapacity * sizeof(char*));
 
         // If memory could not be allocated, return
         if (updatedData == NULL) {
@@ -153,10 +154,11 @@ void vect_add(vect_t *v, const char *elt) {
         // Otherwise, initialize the data and capacity of the new array to the updated values
         v->data = updatedData;
         v->capacity = updatedCapacity;
+        memstats_vect_growth(); // Count the growth event
     }
 
     // Allocate memory for the given element
-    char *element = (char*)malloc(strlen(elt) + 1); // The length of the element + 1 (to account for the null terminator)
+    char *element = (char*)memstats_malloc(memstats_owner(MEMSTATS_VECT), strlen(elt) + 1); // The length of the element + 1 (to account for the null terminator)
 
     // If memory could not be allocated, return
     if (element == NULL) {
@@ -178,7 +180,7 @@ void vect_remove_last(vect_t *v) {
     assert(v != NULL);
 
     // Free the memory of the last element in the given vector
-    free(v->data[v->size - 1]);
+    memstats_free(v->data[v->size - 1]);
 
     // Update the size of the vector
     v->size--;